@@ -0,0 +1,38 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+namespace common {
+
+// Cooperative cancellation flag shared by a group of tasks. Copies share the
+// same flag.
+//
+// Cancelling does not interrupt anything: the pool drops tasks of a cancelled
+// group that have not started yet, and long running tasks are expected to
+// poll IsCancelled() (a single relaxed load) and return early.
+class CancellationToken {
+   public:
+    CancellationToken() : cancelled_(std::make_shared<std::atomic<bool>>()) {}
+
+    // A token that is never cancelled and doesn't allocate.
+    static CancellationToken Never() { return CancellationToken(nullptr); }
+
+    void Cancel() const {
+        if (cancelled_ != nullptr) {
+            cancelled_->store(true, std::memory_order_relaxed);
+        }
+    }
+
+    bool IsCancelled() const {
+        return cancelled_ != nullptr &&
+               cancelled_->load(std::memory_order_relaxed);
+    }
+
+   private:
+    explicit CancellationToken(std::nullptr_t) {}
+
+    std::shared_ptr<std::atomic<bool>> cancelled_;
+};
+
+}  // namespace common
@@ -0,0 +1,239 @@
+#include "cpu_topology.h"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "absl/strings/strip.h"
+
+namespace common {
+
+namespace {
+
+// First line of `path`, without surrounding whitespace.
+std::optional<std::string> ReadLine(const std::string& path) {
+    std::ifstream in(path);
+    std::string line;
+    if (!in.is_open() || !std::getline(in, line)) {
+        return std::nullopt;
+    }
+    return std::string(absl::StripAsciiWhitespace(line));
+}
+
+int ReadInt(const std::string& path, int fallback) {
+    const std::optional<std::string> line = ReadLine(path);
+    int value;
+    if (!line.has_value() || !absl::SimpleAtoi(*line, &value)) {
+        return fallback;
+    }
+    return value;
+}
+
+// CPU quota of the cgroup this process runs in, in CPUs, or nullopt if it is
+// unlimited or unknown.
+std::optional<double> CgroupCpuQuota() {
+    // cgroup v2: "<quota> <period>" or "max <period>" in cpu.max of the
+    // process's own cgroup, named on the "0::" line of /proc/self/cgroup.
+    std::vector<std::string> cpu_max_paths;
+    std::ifstream self("/proc/self/cgroup");
+    std::string line;
+    while (std::getline(self, line)) {
+        absl::string_view path = line;
+        if (absl::ConsumePrefix(&path, "0::")) {
+            cpu_max_paths.push_back(
+                absl::StrCat("/sys/fs/cgroup", path, "/cpu.max"));
+        }
+    }
+    cpu_max_paths.push_back("/sys/fs/cgroup/cpu.max");
+    for (const std::string& path : cpu_max_paths) {
+        const std::optional<std::string> cpu_max = ReadLine(path);
+        if (!cpu_max.has_value()) {
+            continue;
+        }
+        const std::vector<absl::string_view> parts =
+            absl::StrSplit(*cpu_max, ' ', absl::SkipEmpty());
+        double quota;
+        double period;
+        if (parts.size() != 2 || !absl::SimpleAtod(parts[0], &quota) ||
+            !absl::SimpleAtod(parts[1], &period) || quota <= 0 ||
+            period <= 0) {
+            // "max", i.e. unlimited.
+            return std::nullopt;
+        }
+        return quota / period;
+    }
+
+    // cgroup v1: a quota of -1 means unlimited.
+    const int quota = ReadInt("/sys/fs/cgroup/cpu/cpu.cfs_quota_us", -1);
+    const int period = ReadInt("/sys/fs/cgroup/cpu/cpu.cfs_period_us", -1);
+    if (quota > 0 && period > 0) {
+        return static_cast<double>(quota) / period;
+    }
+    return std::nullopt;
+}
+
+// Ids of the CPUs in the affinity mask, or nullopt if it can't be read.
+std::optional<std::vector<int>> AffinityCpuIds() {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+        return std::nullopt;
+    }
+    std::vector<int> ids;
+    for (int id = 0; id < CPU_SETSIZE; ++id) {
+        if (CPU_ISSET(id, &set)) {
+            ids.push_back(id);
+        }
+    }
+    return ids;
+#else
+    return std::nullopt;
+#endif
+}
+
+// `cpus` grouped by socket. Each socket lists one hyperthread of every core
+// before the second hyperthread of any core.
+std::vector<std::vector<Cpu>> OrderBySocket(const std::vector<Cpu>& cpus) {
+    // package -> core -> hyperthreads, all ordered by id.
+    std::map<int, std::map<int, std::vector<Cpu>>> sockets;
+    for (const Cpu& cpu : cpus) {
+        sockets[cpu.package][cpu.core].push_back(cpu);
+    }
+    std::vector<std::vector<Cpu>> ordered;
+    for (const auto& [package, cores] : sockets) {
+        std::vector<Cpu>& socket = ordered.emplace_back();
+        for (size_t sibling = 0;; ++sibling) {
+            bool any = false;
+            for (const auto& [core, threads] : cores) {
+                if (sibling < threads.size()) {
+                    socket.push_back(threads[sibling]);
+                    any = true;
+                }
+            }
+            if (!any) {
+                break;
+            }
+        }
+    }
+    return ordered;
+}
+
+}  // namespace
+
+bool AbslParseFlag(absl::string_view text, Placement* placement,
+                   std::string* error) {
+    if (text == "none") {
+        *placement = Placement::kNone;
+    } else if (text == "compact") {
+        *placement = Placement::kCompact;
+    } else if (text == "scatter") {
+        *placement = Placement::kScatter;
+    } else {
+        *error = "expected one of none, compact, scatter";
+        return false;
+    }
+    return true;
+}
+
+std::string AbslUnparseFlag(Placement placement) {
+    switch (placement) {
+        case Placement::kNone:
+            return "none";
+        case Placement::kCompact:
+            return "compact";
+        case Placement::kScatter:
+            return "scatter";
+    }
+    return "none";
+}
+
+std::vector<Cpu> AvailableCpus() {
+    std::vector<Cpu> cpus;
+    if (const std::optional<std::vector<int>> ids = AffinityCpuIds()) {
+        for (int id : *ids) {
+            const std::string dir =
+                absl::StrCat("/sys/devices/system/cpu/cpu", id, "/topology/");
+            cpus.push_back(Cpu{
+                .id = id,
+                .core = ReadInt(dir + "core_id", id),
+                .package = ReadInt(dir + "physical_package_id", 0),
+            });
+        }
+    }
+    if (cpus.empty()) {
+        const int n = std::max(1u, std::thread::hardware_concurrency());
+        for (int id = 0; id < n; ++id) {
+            cpus.push_back(Cpu{.id = id, .core = id, .package = 0});
+        }
+    }
+    return cpus;
+}
+
+int DefaultThreadCount() {
+    int count = static_cast<int>(AvailableCpus().size());
+    if (const std::optional<double> quota = CgroupCpuQuota()) {
+        count = std::min(count, static_cast<int>(std::ceil(*quota)));
+    }
+    return std::max(1, count);
+}
+
+std::vector<int> PlaceWorkers(int num_threads, Placement placement) {
+    if (placement == Placement::kNone || num_threads <= 0) {
+        return {};
+    }
+    const std::vector<Cpu> cpus = AvailableCpus();
+    const std::vector<std::vector<Cpu>> sockets = OrderBySocket(cpus);
+    std::vector<int> order;
+    if (placement == Placement::kCompact) {
+        for (const std::vector<Cpu>& socket : sockets) {
+            for (const Cpu& cpu : socket) {
+                order.push_back(cpu.id);
+            }
+        }
+    } else {
+        for (size_t i = 0; order.size() < cpus.size(); ++i) {
+            for (const std::vector<Cpu>& socket : sockets) {
+                if (i < socket.size()) {
+                    order.push_back(socket[i].id);
+                }
+            }
+        }
+    }
+    std::vector<int> placed(num_threads);
+    for (int i = 0; i < num_threads; ++i) {
+        placed[i] = order[i % order.size()];
+    }
+    return placed;
+}
+
+bool PinCurrentThread(int cpu) {
+#ifdef __linux__
+    if (cpu < 0 || cpu >= CPU_SETSIZE) {
+        return false;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+}  // namespace common
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+
+namespace common {
+
+// A logical CPU the process is allowed to run on.
+struct Cpu {
+    int id = 0;
+    // Physical core and socket, from /sys/devices/system/cpu. Hyperthreads
+    // of one core share `core` and `package`.
+    int core = 0;
+    int package = 0;
+};
+
+// How ThreadPool workers are pinned to CPUs.
+enum class Placement {
+    // Not pinned; the scheduler is free to migrate workers.
+    kNone,
+    // Fill one socket before moving to the next, so workers share caches.
+    kCompact,
+    // Round-robin over sockets, spreading memory bandwidth and L3.
+    kScatter,
+};
+
+// Flag support: "none", "compact" or "scatter".
+bool AbslParseFlag(absl::string_view text, Placement* placement,
+                   std::string* error);
+std::string AbslUnparseFlag(Placement placement);
+
+// CPUs in this process's affinity mask, ordered by id. Falls back to
+// hardware_concurrency() CPUs on a single socket when the topology can't be
+// read (e.g. on non-Linux systems).
+std::vector<Cpu> AvailableCpus();
+
+// Number of threads the process can keep busy: the size of the affinity mask,
+// capped by the cgroup CPU quota (cgroup v2 cpu.max or v1 cfs quota) rounded
+// up. Always at least 1.
+int DefaultThreadCount();
+
+// Returns the CPU id to pin each of `num_threads` workers to, or an empty
+// vector for Placement::kNone. Within a socket every core gets one worker
+// before any hyperthread sibling gets a second. Wraps around when there are
+// more workers than CPUs.
+std::vector<int> PlaceWorkers(int num_threads, Placement placement);
+
+// Restricts the calling thread to `cpu`. Returns false on failure or on
+// platforms without thread affinity.
+bool PinCurrentThread(int cpu);
+
+}  // namespace common
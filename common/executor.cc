@@ -0,0 +1,41 @@
+#include "executor.h"
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "thread_pool.h"
+
+namespace common {
+
+namespace {
+
+absl::Mutex executor_mu(absl::kConstInit);
+ThreadPool *executor ABSL_GUARDED_BY(executor_mu) = nullptr;
+
+ThreadPool::Options &ExecutorOptions() ABSL_EXCLUSIVE_LOCKS_REQUIRED(
+    executor_mu) {
+    static ThreadPool::Options *options =
+        new ThreadPool::Options{.elastic = true};
+    return *options;
+}
+
+}  // namespace
+
+ThreadPool &DefaultExecutor() {
+    absl::MutexLock l(&executor_mu);
+    if (executor == nullptr) {
+        executor = new ThreadPool(ExecutorOptions());
+    }
+    return *executor;
+}
+
+bool SetDefaultExecutorOptions(const ThreadPool::Options &options) {
+    absl::MutexLock l(&executor_mu);
+    if (executor != nullptr) {
+        return false;
+    }
+    ExecutorOptions() = options;
+    ExecutorOptions().elastic = true;
+    return true;
+}
+
+}  // namespace common
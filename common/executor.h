@@ -0,0 +1,21 @@
+#pragma once
+
+#include "thread_pool.h"
+
+namespace common {
+
+// Process-wide elastic ThreadPool for components that want parallelism but
+// shouldn't each own threads. Created on first use, so programs that never
+// schedule anything start no threads, and never destroyed.
+//
+// With default ThreadPool::Options it keeps no idle workers, grows up to
+// DefaultThreadCount() while tasks back up and retires workers after ten idle
+// seconds. Takes a lock, so fetch it once per parallel operation rather than
+// once per task.
+ThreadPool &DefaultExecutor();
+
+// Replaces the options DefaultExecutor() is created with; `elastic` is always
+// set. Returns false, changing nothing, if it has already been created.
+bool SetDefaultExecutorOptions(const ThreadPool::Options &options);
+
+}  // namespace common
@@ -0,0 +1,25 @@
+#include "file_io.h"
+
+#include <unistd.h>
+
+#include <cerrno>
+
+#include "absl/strings/string_view.h"
+
+namespace common {
+
+bool WriteAll(int fd, absl::string_view data) {
+    while (!data.empty()) {
+        const ssize_t written = write(fd, data.data(), data.size());
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        data.remove_prefix(written);
+    }
+    return true;
+}
+
+}  // namespace common
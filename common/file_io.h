@@ -0,0 +1,11 @@
+#pragma once
+
+#include "absl/strings/string_view.h"
+
+namespace common {
+
+// Writes all of `data` to `fd`, retrying short writes and writes interrupted
+// by a signal. Returns false on any other error, with errno set.
+bool WriteAll(int fd, absl::string_view data);
+
+}  // namespace common
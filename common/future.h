@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cassert>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+#include "absl/synchronization/notification.h"
+
+namespace common {
+
+template <typename T>
+class Promise;
+
+// Handle to the result of a task scheduled with ThreadPool::Submit.
+//
+// A task can finish in two ways: it runs and produces a value, or it is
+// dropped without running because its CancellationToken was cancelled while
+// it was still queued. Tasks returning void produce std::monostate.
+template <typename T>
+class Future {
+   public:
+    using Value = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+
+    Future() = default;
+
+    bool valid() const { return state_ != nullptr; }
+
+    // True once the task has run or been dropped. Never blocks.
+    bool IsReady() const { return state_->done.HasBeenNotified(); }
+
+    // Blocks until the task has run or been dropped.
+    void Wait() const { state_->done.WaitForNotification(); }
+
+    // Blocks; returns false if the task was dropped.
+    bool Ran() const {
+        Wait();
+        return state_->value.has_value();
+    }
+
+    // Blocks and returns the task's result. Requires Ran().
+    Value &Get() const {
+        Wait();
+        assert(state_->value.has_value());
+        return *state_->value;
+    }
+
+   private:
+    friend class Promise<T>;
+
+    struct State {
+        std::optional<Value> value;
+        absl::Notification done;
+    };
+
+    explicit Future(std::shared_ptr<State> state) : state_(std::move(state)) {}
+
+    std::shared_ptr<State> state_;
+};
+
+// Write side of a Future. Move-only; if it is destroyed without a value
+// having been set, the Future reports the task as dropped.
+template <typename T>
+class Promise {
+   public:
+    using Value = typename Future<T>::Value;
+
+    Promise() : state_(std::make_shared<typename Future<T>::State>()) {}
+
+    Promise(Promise &&) = default;
+    Promise &operator=(Promise &&) = default;
+    Promise(const Promise &) = delete;
+    Promise &operator=(const Promise &) = delete;
+
+    ~Promise() {
+        if (state_ != nullptr && !state_->done.HasBeenNotified()) {
+            state_->done.Notify();
+        }
+    }
+
+    Future<T> GetFuture() const { return Future<T>(state_); }
+
+    void Set(Value value) {
+        state_->value.emplace(std::move(value));
+        state_->done.Notify();
+    }
+
+   private:
+    std::shared_ptr<typename Future<T>::State> state_;
+};
+
+}  // namespace common
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+
+namespace common {
+
+// A whole file mapped read-only into memory. Views into contents() stay valid
+// for the lifetime of the MappedFile, so inputs can be parsed without copying
+// them into strings first.
+class MappedFile {
+   public:
+    // Returns nullptr if `path` can't be opened, sized or mapped.
+    static std::unique_ptr<MappedFile> Open(const std::string& path);
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    absl::string_view contents() const {
+        return absl::string_view(static_cast<const char*>(data_), size_);
+    }
+
+    // The lines of the file, without their '\n'. A newline at the end of the
+    // file doesn't start another, empty line.
+    std::vector<absl::string_view> Lines() const;
+
+   private:
+    MappedFile(const void* data, size_t size) : data_(data), size_(size) {}
+
+    // nullptr for an empty file, which can't be mapped.
+    const void* data_;
+    size_t size_;
+};
+
+}  // namespace common
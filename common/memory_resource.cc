@@ -0,0 +1,130 @@
+#include "memory_resource.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <string>
+
+#include "absl/strings/string_view.h"
+
+namespace common {
+
+namespace {
+
+size_t RoundUpToHugePages(size_t bytes) {
+    constexpr size_t kMask = HugePageResource::kHugePageSize - 1;
+    return (std::max<size_t>(bytes, 1) + kMask) & ~kMask;
+}
+
+}  // namespace
+
+bool AbslParseFlag(absl::string_view text, MemoryBacking* backing,
+                   std::string* error) {
+    if (text == "heap") {
+        *backing = MemoryBacking::kHeap;
+    } else if (text == "arena") {
+        *backing = MemoryBacking::kArena;
+    } else if (text == "huge_pages") {
+        *backing = MemoryBacking::kHugePages;
+    } else {
+        *error = "expected one of heap, arena, huge_pages";
+        return false;
+    }
+    return true;
+}
+
+std::string AbslUnparseFlag(MemoryBacking backing) {
+    switch (backing) {
+        case MemoryBacking::kHeap:
+            return "heap";
+        case MemoryBacking::kArena:
+            return "arena";
+        case MemoryBacking::kHugePages:
+            return "huge_pages";
+    }
+    return "heap";
+}
+
+void* HugePageResource::do_allocate(size_t bytes, size_t /*alignment*/) {
+    const size_t size = RoundUpToHugePages(bytes);
+    void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED) {
+        return p;
+    }
+    // No reserved huge pages. Map an extra huge page so the block can be
+    // trimmed to 2MiB alignment, which transparent huge pages need.
+    p = mmap(nullptr, size + kHugePageSize, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+    const uintptr_t start = reinterpret_cast<uintptr_t>(p);
+    const uintptr_t aligned =
+        (start + kHugePageSize - 1) & ~(uintptr_t{kHugePageSize} - 1);
+    if (aligned > start) {
+        munmap(p, aligned - start);
+    }
+    munmap(reinterpret_cast<void*>(aligned + size),
+           start + kHugePageSize - aligned);
+    madvise(reinterpret_cast<void*>(aligned), size, MADV_HUGEPAGE);
+    return reinterpret_cast<void*>(aligned);
+}
+
+void HugePageResource::do_deallocate(void* p, size_t bytes,
+                                     size_t /*alignment*/) {
+    munmap(p, RoundUpToHugePages(bytes));
+}
+
+void* CountingResource::do_allocate(size_t bytes, size_t alignment) {
+    void* p = upstream_->allocate(bytes, alignment);
+    ++allocations_;
+    bytes_in_use_ += bytes;
+    peak_bytes_ = std::max(peak_bytes_, bytes_in_use_);
+    return p;
+}
+
+void CountingResource::do_deallocate(void* p, size_t bytes,
+                                     size_t alignment) {
+    upstream_->deallocate(p, bytes, alignment);
+    bytes_in_use_ -= bytes;
+}
+
+MemoArena::MemoArena(MemoryBacking backing)
+    : backing_(backing),
+      counting_(backing == MemoryBacking::kHugePages
+                    ? static_cast<std::pmr::memory_resource*>(&huge_pages_)
+                    : std::pmr::new_delete_resource()),
+      top_(&counting_) {
+    if (backing == MemoryBacking::kHeap) {
+        return;
+    }
+    // Huge page blocks start at one huge page, so the arena's geometrically
+    // growing blocks are never rounded up.
+    const size_t initial_block = backing == MemoryBacking::kHugePages
+                                     ? HugePageResource::kHugePageSize
+                                     : size_t{64} << 10;
+    arena_ = std::make_unique<std::pmr::monotonic_buffer_resource>(
+        initial_block, &counting_);
+    top_ = arena_.get();
+}
+
+int64_t ResidentSetBytes() {
+    // statm holds the total and resident sizes in pages.
+    std::ifstream statm("/proc/self/statm");
+    int64_t total_pages = 0;
+    int64_t resident_pages = 0;
+    if (!(statm >> total_pages >> resident_pages)) {
+        return -1;
+    }
+    return resident_pages * sysconf(_SC_PAGESIZE);
+}
+
+}  // namespace common
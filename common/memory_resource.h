@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <string>
+
+#include "absl/strings/string_view.h"
+
+namespace common {
+
+// Where a solver's memo tables get their memory from.
+enum class MemoryBacking {
+    // The general-purpose heap; entries are freed one by one.
+    kHeap,
+    // A monotonic arena on the heap. Nothing is freed until the arena goes
+    // away, and then all of it at once.
+    kArena,
+    // A monotonic arena in 2MiB pages: reserved huge pages (MAP_HUGETLB) if
+    // there are any, transparent huge pages otherwise.
+    kHugePages,
+};
+
+// Flag support: "heap", "arena" or "huge_pages".
+bool AbslParseFlag(absl::string_view text, MemoryBacking* backing,
+                   std::string* error);
+std::string AbslUnparseFlag(MemoryBacking backing);
+
+// Maps memory straight from the OS in multiples of 2MiB, aligned to 2MiB so
+// that every page can be a huge page. Meant as the upstream of an arena, since
+// every allocation is rounded up.
+class HugePageResource : public std::pmr::memory_resource {
+   public:
+    static constexpr size_t kHugePageSize = size_t{2} << 20;
+
+   private:
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+    bool do_is_equal(
+        const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+};
+
+// Passes allocations through to `upstream` and keeps count of them. Not
+// thread-safe.
+class CountingResource : public std::pmr::memory_resource {
+   public:
+    explicit CountingResource(std::pmr::memory_resource* upstream)
+        : upstream_(upstream) {}
+
+    int64_t allocations() const { return allocations_; }
+    int64_t bytes_in_use() const { return bytes_in_use_; }
+    int64_t peak_bytes() const { return peak_bytes_; }
+
+   private:
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+    bool do_is_equal(
+        const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+
+    std::pmr::memory_resource* const upstream_;
+    int64_t allocations_ = 0;
+    int64_t bytes_in_use_ = 0;
+    int64_t peak_bytes_ = 0;
+};
+
+// The memory of one memo table and everything its entries own, backed as
+// `backing` says. Use resource() through std::pmr containers and allocators
+// from a single thread.
+class MemoArena {
+   public:
+    explicit MemoArena(MemoryBacking backing);
+
+    MemoArena(const MemoArena&) = delete;
+    MemoArena& operator=(const MemoArena&) = delete;
+
+    MemoryBacking backing() const { return backing_; }
+    std::pmr::memory_resource* resource() { return top_; }
+
+    // Most memory taken from the heap or the OS at once, including the
+    // arena's unused slack.
+    int64_t peak_bytes() const { return counting_.peak_bytes(); }
+
+   private:
+    const MemoryBacking backing_;
+    HugePageResource huge_pages_;
+    CountingResource counting_;
+    // Null for MemoryBacking::kHeap.
+    std::unique_ptr<std::pmr::monotonic_buffer_resource> arena_;
+    std::pmr::memory_resource* top_;
+};
+
+// Resident set size of the process, or -1 if it can't be read.
+int64_t ResidentSetBytes();
+
+}  // namespace common
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "absl/types/span.h"
+
+namespace common {
+
+// Bounded lock-free multi-producer multi-consumer ring buffer (Dmitry
+// Vyukov's design). Each cell carries a sequence number that says whether it
+// is free for the producer of the current lap or holds a value for the
+// consumer, so producers and consumers only contend on their own cursor.
+//
+// T must be cheap to copy; the pool stores raw task pointers in it.
+template <typename T>
+class BoundedMpmcQueue {
+   public:
+    // `capacity` is rounded up to a power of two.
+    explicit BoundedMpmcQueue(size_t capacity) {
+        capacity_ = 1;
+        while (capacity_ < capacity) {
+            capacity_ <<= 1;
+        }
+        mask_ = capacity_ - 1;
+        cells_.reset(new Cell[capacity_]);
+        for (size_t i = 0; i < capacity_; ++i) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    BoundedMpmcQueue(const BoundedMpmcQueue &) = delete;
+    BoundedMpmcQueue &operator=(const BoundedMpmcQueue &) = delete;
+
+    size_t capacity() const { return capacity_; }
+
+    // Returns false if the queue is full.
+    bool TryPush(T value) { return TryPushBatch({&value, 1}) == 1; }
+
+    // Pushes a prefix of `values` with a single claim on the producer cursor
+    // and returns its length: all of `values` unless the queue fills up.
+    size_t TryPushBatch(absl::Span<const T> values) {
+        if (values.empty()) {
+            return 0;
+        }
+        size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+        size_t count;
+        while (true) {
+            // Count how many consecutive cells are free for this lap.
+            count = 0;
+            bool stale = false;
+            while (count < values.size() && count < capacity_) {
+                const size_t seq = cells_[(pos + count) & mask_].sequence.load(
+                    std::memory_order_acquire);
+                const intptr_t diff = static_cast<intptr_t>(seq) -
+                                      static_cast<intptr_t>(pos + count);
+                if (diff > 0) {
+                    stale = true;  // Another producer already claimed it.
+                }
+                if (diff != 0) {
+                    break;
+                }
+                ++count;
+            }
+            if (count == 0 && !stale) {
+                return 0;  // Full.
+            }
+            if (count > 0 && enqueue_pos_.compare_exchange_weak(
+                                 pos, pos + count, std::memory_order_relaxed)) {
+                break;
+            }
+            if (count == 0) {
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+        for (size_t i = 0; i < count; ++i) {
+            Cell &cell = cells_[(pos + i) & mask_];
+            cell.value = values[i];
+            cell.sequence.store(pos + i + 1, std::memory_order_release);
+        }
+        return count;
+    }
+
+    // Returns false if the queue is empty.
+    bool TryPop(T &value) {
+        size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+        while (true) {
+            Cell &cell = cells_[pos & mask_];
+            const size_t seq = cell.sequence.load(std::memory_order_acquire);
+            const intptr_t diff =
+                static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (dequeue_pos_.compare_exchange_weak(
+                        pos, pos + 1, std::memory_order_relaxed)) {
+                    value = cell.value;
+                    cell.sequence.store(pos + capacity_,
+                                        std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;  // Empty.
+            } else {
+                pos = dequeue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Racy snapshot, only suitable as a hint.
+    size_t ApproximateSize() const {
+        const size_t head = dequeue_pos_.load(std::memory_order_relaxed);
+        const size_t tail = enqueue_pos_.load(std::memory_order_relaxed);
+        return tail > head ? tail - head : 0;
+    }
+
+   private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    size_t capacity_;
+    size_t mask_;
+    std::unique_ptr<Cell[]> cells_;
+    alignas(64) std::atomic<size_t> enqueue_pos_{0};
+    alignas(64) std::atomic<size_t> dequeue_pos_{0};
+};
+
+}  // namespace common
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+
+namespace common {
+
+// Process-wide free-list allocator for objects of type T.
+//
+// Each thread keeps a small cache of free slots. Slots freed on one thread
+// and allocated on another (the usual producer/worker pattern of a thread
+// pool) flow through a shared free list in batches, so the shared lock is
+// taken once per kBatch objects. Memory is carved from slabs that are never
+// returned to the heap; in steady state New and Delete don't allocate.
+template <typename T>
+class ObjectPool {
+   public:
+    template <typename... Args>
+    static T *New(Args &&...args) {
+        Cache &cache = LocalCache();
+        if (cache.free.empty()) {
+            Shared().Refill(cache.free);
+        }
+        void *slot = cache.free.back();
+        cache.free.pop_back();
+        return new (slot) T(std::forward<Args>(args)...);
+    }
+
+    static void Delete(T *object) {
+        object->~T();
+        Cache &cache = LocalCache();
+        cache.free.push_back(object);
+        if (cache.free.size() >= 2 * kBatch) {
+            Shared().Release(cache.free, kBatch);
+        }
+    }
+
+   private:
+    static constexpr size_t kBatch = 256;
+
+    union Slot {
+        Slot() {}
+        ~Slot() {}
+        alignas(T) unsigned char storage[sizeof(T)];
+    };
+
+    class SharedPool {
+       public:
+        // Moves up to kBatch free slots into `out`, carving a new slab if the
+        // shared list is empty.
+        void Refill(std::vector<void *> &out) {
+            absl::MutexLock l(&mu_);
+            if (free_.empty()) {
+                slabs_.push_back(std::make_unique<Slot[]>(kBatch));
+                for (size_t i = 0; i < kBatch; ++i) {
+                    free_.push_back(&slabs_.back()[i]);
+                }
+            }
+            const size_t n = std::min(kBatch, free_.size());
+            out.insert(out.end(), free_.end() - n, free_.end());
+            free_.resize(free_.size() - n);
+        }
+
+        // Moves the last `n` slots of `in` to the shared list.
+        void Release(std::vector<void *> &in, size_t n) {
+            absl::MutexLock l(&mu_);
+            free_.insert(free_.end(), in.end() - n, in.end());
+            in.resize(in.size() - n);
+        }
+
+       private:
+        absl::Mutex mu_;
+        std::vector<void *> free_ ABSL_GUARDED_BY(mu_);
+        std::vector<std::unique_ptr<Slot[]>> slabs_ ABSL_GUARDED_BY(mu_);
+    };
+
+    struct Cache {
+        Cache() { free.reserve(2 * kBatch); }
+        ~Cache() {
+            if (!free.empty()) {
+                Shared().Release(free, free.size());
+            }
+        }
+        std::vector<void *> free;
+    };
+
+    static SharedPool &Shared() {
+        // Leaked so thread caches can flush into it during shutdown.
+        static SharedPool *shared = new SharedPool();
+        return *shared;
+    }
+
+    static Cache &LocalCache() {
+        thread_local Cache cache;
+        return cache;
+    }
+};
+
+}  // namespace common
@@ -0,0 +1,208 @@
+#include "runner.h"
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/str_join.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+#include "mapped_file.h"
+#include "trace.h"
+
+ABSL_FLAG(std::string, input, "infile.txt",
+          "Puzzle input, relative to the working directory.");
+ABSL_FLAG(std::string, engine, "",
+          "Solver engine to run. Empty picks the binary's default.");
+ABSL_FLAG(int, warmup, 0, "Untimed runs before the timed ones.");
+ABSL_FLAG(int, repeat, 1, "Timed runs, each parsing and solving afresh.");
+ABSL_FLAG(bool, json, false,
+          "Print the answer and timings as one JSON object on stdout.");
+ABSL_FLAG(std::string, trace, "",
+          "If set, a Chrome trace_event timeline of every run is written to "
+          "this file, for loading into Perfetto.");
+
+namespace common {
+
+namespace {
+
+// Timings of one phase over every timed run, sorted.
+struct PhaseTimes {
+    explicit PhaseTimes(std::vector<absl::Duration> samples)
+        : sorted(std::move(samples)) {
+        std::sort(sorted.begin(), sorted.end());
+    }
+
+    // Nearest-rank quantile, `quantile` in (0, 1].
+    absl::Duration Quantile(double quantile) const {
+        const size_t rank = std::ceil(quantile * sorted.size());
+        return sorted[std::max<size_t>(rank, 1) - 1];
+    }
+
+    std::string Summary() const {
+        return absl::StrCat("min ", absl::FormatDuration(sorted.front()),
+                            "  median ", absl::FormatDuration(Quantile(0.5)),
+                            "  p99 ", absl::FormatDuration(Quantile(0.99)));
+    }
+
+    std::string Json() const {
+        return absl::StrFormat(
+            R"({"min_ns": %d, "median_ns": %d, "p99_ns": %d, )"
+            R"("samples_ns": [%s]})",
+            absl::ToInt64Nanoseconds(sorted.front()),
+            absl::ToInt64Nanoseconds(Quantile(0.5)),
+            absl::ToInt64Nanoseconds(Quantile(0.99)),
+            absl::StrJoin(sorted, ", ",
+                          [](std::string *out, absl::Duration d) {
+                              absl::StrAppend(out,
+                                              absl::ToInt64Nanoseconds(d));
+                          }));
+    }
+
+    std::vector<absl::Duration> sorted;
+};
+
+std::string JsonString(absl::string_view s) {
+    std::string ret = "\"";
+    for (const char c : s) {
+        if (c == '"' || c == '\\') {
+            absl::StrAppend(&ret, "\\", std::string(1, c));
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            absl::StrAppendFormat(&ret, "\\u%04x", static_cast<int>(c));
+        } else {
+            ret.push_back(c);
+        }
+    }
+    ret.push_back('"');
+    return ret;
+}
+
+int64_t PeakRssBytes() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return -1;
+    }
+    // Linux reports kilobytes.
+    return int64_t{usage.ru_maxrss} * 1024;
+}
+
+absl::Duration Since(std::chrono::steady_clock::time_point start) {
+    return absl::FromChrono(std::chrono::steady_clock::now() - start);
+}
+
+}  // namespace
+
+int RunSolver(std::vector<Engine> engines) {
+    const std::string engine_name = absl::GetFlag(FLAGS_engine);
+    auto engine = engines.begin();
+    if (!engine_name.empty()) {
+        engine = std::find_if(
+            engines.begin(), engines.end(),
+            [&engine_name](const Engine &e) { return e.name == engine_name; });
+    }
+    if (engine == engines.end()) {
+        std::cerr << "Unknown engine " << engine_name << "; choose from "
+                  << absl::StrJoin(engines, ", ",
+                                   [](std::string *out, const Engine &e) {
+                                       absl::StrAppend(out, e.name);
+                                   })
+                  << std::endl;
+        return 1;
+    }
+    const int warmup = absl::GetFlag(FLAGS_warmup);
+    const int repeat = absl::GetFlag(FLAGS_repeat);
+    if (warmup < 0 || repeat < 1) {
+        std::cerr << "Need --warmup >= 0 and --repeat >= 1" << std::endl;
+        return 1;
+    }
+    const std::string path = absl::GetFlag(FLAGS_input);
+    const std::unique_ptr<MappedFile> input = MappedFile::Open(path);
+    if (input == nullptr) {
+        std::cerr << "Failed to map " << path << std::endl;
+        return 1;
+    }
+
+    const std::string trace_path = absl::GetFlag(FLAGS_trace);
+    if (!trace_path.empty()) {
+        StartTracing();
+    }
+    std::string answer;
+    std::vector<absl::Duration> parse_times;
+    std::vector<absl::Duration> solve_times;
+    for (int run = 0; run < warmup + repeat; ++run) {
+        auto start = std::chrono::steady_clock::now();
+        SolveFn solve;
+        {
+            TraceSpan span("parse", "run", run);
+            solve = engine->parse(*input);
+        }
+        const absl::Duration parse_time = Since(start);
+        if (!solve) {
+            std::cerr << "Engine " << engine->name << " failed to parse "
+                      << path << std::endl;
+            return 1;
+        }
+        start = std::chrono::steady_clock::now();
+        std::string run_answer;
+        {
+            TraceSpan span("solve", "run", run);
+            run_answer = solve();
+        }
+        const absl::Duration solve_time = Since(start);
+        if (run_answer.empty()) {
+            std::cerr << "Engine " << engine->name << " failed to solve "
+                      << path << std::endl;
+            return 1;
+        }
+        if (run > 0 && run_answer != answer) {
+            std::cerr << "Run " << run << " answered " << run_answer
+                      << " instead of " << answer << std::endl;
+            return 1;
+        }
+        answer = std::move(run_answer);
+        if (run >= warmup) {
+            parse_times.push_back(parse_time);
+            solve_times.push_back(solve_time);
+        }
+    }
+
+    if (!trace_path.empty() && !WriteTrace(trace_path)) {
+        std::cerr << "Failed to write trace " << trace_path << std::endl;
+        return 1;
+    }
+
+    const PhaseTimes parse(std::move(parse_times));
+    const PhaseTimes solve(std::move(solve_times));
+    const int64_t peak_rss = PeakRssBytes();
+    if (absl::GetFlag(FLAGS_json)) {
+        std::cout << absl::StrFormat(
+                         R"({"input": %s, "engine": %s, "answer": %s, )"
+                         R"("warmup": %d, "repeat": %d, "parse": %s, )"
+                         R"("solve": %s, "peak_rss_bytes": %d})",
+                         JsonString(path), JsonString(engine->name),
+                         JsonString(answer), warmup, repeat, parse.Json(),
+                         solve.Json(), peak_rss)
+                  << std::endl;
+        return 0;
+    }
+    std::cout << answer << std::endl;
+    std::cerr << absl::StrFormat(
+        "%s: %d runs after %d warmup\n  parse  %s\n  solve  %s\n  peak RSS "
+        "%.1f MiB\n",
+        engine->name, repeat, warmup, parse.Summary(), solve.Summary(),
+        peak_rss / (1024.0 * 1024.0));
+    return 0;
+}
+
+}  // namespace common
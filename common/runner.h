@@ -0,0 +1,37 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "absl/flags/declare.h"
+#include "absl/functional/any_invocable.h"
+#include "mapped_file.h"
+
+// Set when the report goes to stdout, so engines writing there must refuse.
+ABSL_DECLARE_FLAG(bool, json);
+
+namespace common {
+
+// Computes the answer from the state built by an Engine's parse step. An
+// empty answer means solving failed, e.g. on an I/O error.
+using SolveFn = absl::AnyInvocable<std::string()>;
+
+// One way of solving a puzzle. `parse` builds the solver's state from the
+// input and returns the function that solves it, or an empty function if the
+// input can't be used. Every run parses afresh, so `solve` may consume the
+// state.
+struct Engine {
+    std::string name;
+    absl::AnyInvocable<SolveFn(const MappedFile &input)> parse;
+};
+
+// Shared main() of the solver binaries, called after absl::ParseCommandLine.
+// Maps --input, runs the --engine named engine (the first by default)
+// --warmup times untimed and --repeat times timed, and reports the answer
+// with min/median/p99 parse and solve times and the peak RSS. The answer goes
+// to stdout and the timings to stderr, or all of it to stdout as one JSON
+// object with --json. With --trace, the runs are also traced (see trace.h).
+// Returns the exit code, which is nonzero if a run fails.
+int RunSolver(std::vector<Engine> engines);
+
+}  // namespace common
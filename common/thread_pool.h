@@ -0,0 +1,845 @@
+#pragma once
+
+#include <atomic>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/inlined_vector.h"
+#include "absl/functional/any_invocable.h"
+#include "absl/functional/function_ref.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/synchronization/notification.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "cancellation.h"
+#include "cpu_topology.h"
+#include "future.h"
+#include "mpmc_queue.h"
+#include "object_pool.h"
+#include "thread_pool_stats.h"
+#include "trace.h"
+#include "work_stealing_deque.h"
+
+namespace common {
+
+// Half-open range of indices [begin, end).
+struct IndexRange {
+    int64_t begin;
+    int64_t end;
+
+    int64_t size() const { return end > begin ? end - begin : 0; }
+};
+
+// Work-stealing thread pool.
+//
+// Every worker owns a Chase-Lev deque. Tasks scheduled from inside a worker
+// go to that worker's deque and are popped LIFO by the owner; tasks scheduled
+// from other threads go to a bounded lock-free MPMC injection ring. Idle
+// workers take from the ring or steal FIFO from a random victim, and only
+// park on a condition variable after a short spin finds nothing.
+//
+// Each Priority level has its own ring and its own deque per worker. A worker
+// looking for work drains the levels from high to low, stealing high
+// priority tasks before running its own lower priority ones. To keep low
+// priority tasks moving, one in every kStarvationPeriod tasks a worker takes
+// is looked for from the lowest level up instead.
+//
+// Task objects come from a free-list pool, so scheduling does not touch the
+// heap in steady state (unless the callable itself is too large to be stored
+// inline by absl::AnyInvocable).
+//
+// Tasks may belong to a group sharing a CancellationToken. Queued tasks of a
+// cancelled group are dropped instead of run.
+//
+// Runtime metrics (queue depth, latency histograms, per-worker utilization and
+// contention counts) are always collected, using per-worker counters and
+// relaxed atomics. Latencies are sampled to keep clock reads off the per-task
+// path. See Stats() and LogStatsEvery().
+//
+// An elastic pool (Options::elastic) starts min_threads workers, adds workers
+// while tasks back up, up to num_threads, and retires workers that stayed idle
+// for idle_timeout. Worker slots, and their deques, are allocated for the cap
+// up front; only the threads come and go.
+//
+// The destructor runs every task scheduled before it was called, except
+// those dropped through cancellation.
+class ThreadPool {
+   public:
+    // Tasks of a higher priority start before queued tasks of a lower one.
+    enum class Priority {
+        kLow = 0,
+        kNormal = 1,
+        kHigh = 2,
+    };
+    static constexpr int kNumPriorities = 3;
+
+    // What Schedule does when the injection ring is full.
+    enum class FullPolicy {
+        // Wait for workers to make room. Provides backpressure.
+        kBlock,
+        // Return false without scheduling.
+        kReject,
+    };
+
+    struct Options {
+        // 0 sizes the pool with DefaultThreadCount(): the CPUs this process
+        // may run on, capped by its cgroup CPU quota.
+        int num_threads = 0;
+        // Pins each worker to one CPU. Pinning pays off for long CPU-bound
+        // tasks on multi-socket machines; leave it off when the pool shares
+        // the machine with other busy processes.
+        Placement placement = Placement::kNone;
+        // Capacity of each priority's injection ring, used by threads outside
+        // the pool. Rounded up to a power of two. Tasks scheduled from pool
+        // workers go to their unbounded local deques and never block.
+        size_t queue_capacity = 1 << 16;
+        FullPolicy full_policy = FullPolicy::kBlock;
+
+        // If set, num_threads is a cap rather than a fixed size: the pool
+        // keeps between min_threads and num_threads workers alive.
+        bool elastic = false;
+        // With 0, no thread is started before the first task is scheduled.
+        int min_threads = 0;
+        absl::Duration idle_timeout = absl::Seconds(10);
+    };
+
+    explicit ThreadPool(int num_threads)
+        : ThreadPool(Options{.num_threads = num_threads}) {}
+
+    explicit ThreadPool(const Options &options)
+        : num_threads_(options.num_threads > 0 ? options.num_threads
+                                               : DefaultThreadCount()),
+          full_policy_(options.full_policy),
+          worker_cpus_(PlaceWorkers(num_threads_, options.placement)),
+          elastic_(options.elastic),
+          min_threads_(options.elastic
+                           ? std::clamp(options.min_threads, 0, num_threads_)
+                           : num_threads_),
+          idle_timeout_(options.idle_timeout),
+          start_(absl::Now()) {
+        for (auto &ring : injection_) {
+            ring = std::make_unique<BoundedMpmcQueue<Task *>>(
+                options.queue_capacity);
+        }
+        workers_.reserve(num_threads_);
+        for (int i = 0; i < num_threads_; ++i) {
+            workers_.push_back(std::make_unique<Worker>());
+        }
+        absl::MutexLock l(&grow_mu_);
+        while (live_.load(std::memory_order_relaxed) < min_threads_) {
+            StartWorkerLocked();
+        }
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    ~ThreadPool() {
+        stop_logging_.Notify();
+        if (stats_logger_.joinable()) {
+            stats_logger_.join();
+        }
+        {
+            absl::MutexLock l(&sleep_mu_);
+            stopping_.store(true, std::memory_order_seq_cst);
+            sleep_cv_.SignalAll();
+        }
+        // Once `stopping_` is set no worker is started, so the threads can be
+        // joined without holding grow_mu_, which retiring workers take.
+        grow_mu_.Lock();
+        grow_mu_.Unlock();
+        for (auto &w : workers_) {
+            if (w->thread.joinable()) {
+                w->thread.join();
+            }
+        }
+    }
+
+    // The number of workers, or their cap for an elastic pool.
+    int size() const { return num_threads_; }
+
+    // Workers currently running.
+    int live_threads() const { return live_.load(std::memory_order_relaxed); }
+
+    // Snapshot of the pool's metrics. Counters are read one at a time while
+    // the pool keeps running, so they need not add up exactly.
+    ThreadPoolStats Stats() const {
+        ThreadPoolStats stats;
+        stats.uptime = absl::Now() - start_;
+        stats.queue_depth =
+            std::max<int64_t>(0, pending_.load(std::memory_order_relaxed));
+        stats.peak_queue_depth =
+            peak_pending_.load(std::memory_order_relaxed);
+        stats.parked_workers = num_sleeping_.load(std::memory_order_relaxed);
+        stats.live_workers = live_threads();
+        stats.injection_full = injection_full_.load(std::memory_order_relaxed);
+        stats.park_lock_contended =
+            park_lock_contended_.load(std::memory_order_relaxed);
+        const int64_t now = NowNanos();
+        for (const auto &w : workers_) {
+            const WorkerCounters &c = w->counters;
+            c.queue_wait.AddTo(stats.queue_wait);
+            c.run_time.AddTo(stats.run_time);
+            // Include the run of tasks in progress, so that a long backlog
+            // doesn't show up as idle until it drains. Loading busy_ns first
+            // pairs with WorkLoop, which clears busy_since_ns before it
+            // publishes the finished run.
+            const int64_t busy_ns = c.busy_ns.load(std::memory_order_acquire);
+            const int64_t busy_since =
+                c.busy_since_ns.load(std::memory_order_relaxed);
+            const absl::Duration busy = absl::Nanoseconds(
+                busy_ns + (busy_since != 0
+                               ? std::max<int64_t>(0, now - busy_since)
+                               : 0));
+            stats.workers.push_back(WorkerStats{
+                .tasks_executed =
+                    c.tasks_executed.load(std::memory_order_relaxed),
+                .tasks_dropped =
+                    c.tasks_dropped.load(std::memory_order_relaxed),
+                .steals = c.steals.load(std::memory_order_relaxed),
+                .steal_conflicts =
+                    c.steal_conflicts.load(std::memory_order_relaxed),
+                .busy = busy,
+                .idle = std::max(absl::ZeroDuration(), stats.uptime - busy),
+            });
+        }
+        return stats;
+    }
+
+    // Writes Stats().DebugString() to stderr every `interval` until the pool
+    // is destroyed. Call at most once.
+    void LogStatsEvery(absl::Duration interval) {
+        assert(!stats_logger_.joinable());
+        stats_logger_ = std::thread([this, interval]() {
+            while (!stop_logging_.WaitForNotificationWithTimeout(interval)) {
+                std::cerr << Stats().DebugString() << std::flush;
+            }
+        });
+    }
+
+    // Returns false only under FullPolicy::kReject when the injection ring is
+    // full, in which case `func` is dropped. If `token` is cancelled before
+    // the task starts, the task is dropped without running.
+    bool Schedule(absl::AnyInvocable<void()> func,
+                  const CancellationToken &token = CancellationToken::Never(),
+                  Priority priority = Priority::kNormal) {
+        assert(func != nullptr);
+        return ScheduleBatch({&func, 1}, token, priority) == 1;
+    }
+
+    // Schedules every task in `funcs`, moving out of them, with a single
+    // claim on the injection ring and a single wakeup. Under
+    // FullPolicy::kReject only a prefix may fit; its length is returned and
+    // the remaining entries of `funcs` are left untouched.
+    size_t ScheduleBatch(
+        absl::Span<absl::AnyInvocable<void()>> funcs,
+        const CancellationToken &token = CancellationToken::Never(),
+        Priority priority = Priority::kNormal) {
+        if (funcs.empty()) {
+            return 0;
+        }
+        absl::InlinedVector<Task *, 64> tasks;
+        tasks.reserve(funcs.size());
+        const int64_t now = SampleSchedule() ? NowNanos() : 0;
+        for (absl::AnyInvocable<void()> &func : funcs) {
+            assert(func != nullptr);
+            tasks.push_back(
+                ObjectPool<Task>::New(std::move(func), token, now));
+        }
+
+        const int level = static_cast<int>(priority);
+        const CurrentWorker &current = Current();
+        if (current.pool == this) {
+            for (Task *task : tasks) {
+                workers_[current.index]->deques[level].Push(task);
+            }
+            Published(tasks.size());
+            return tasks.size();
+        }
+        const size_t scheduled = Inject(level, tasks);
+        // Hand the rejected callables back to the caller.
+        for (size_t i = scheduled; i < tasks.size(); ++i) {
+            funcs[i] = std::move(tasks[i]->fn);
+            ObjectPool<Task>::Delete(tasks[i]);
+        }
+        return scheduled;
+    }
+
+    // Schedules `fn` and returns a handle to its result. The future reports
+    // the task as dropped if `token` is cancelled before the task starts, or
+    // if the injection ring rejected it.
+    template <typename Fn>
+    Future<std::invoke_result_t<Fn &>> Submit(
+        Fn fn, const CancellationToken &token = CancellationToken::Never(),
+        Priority priority = Priority::kNormal) {
+        using T = std::invoke_result_t<Fn &>;
+        Promise<T> promise;
+        Future<T> future = promise.GetFuture();
+        Schedule(
+            [fn = std::move(fn), promise = std::move(promise)]() mutable {
+                if constexpr (std::is_void_v<T>) {
+                    fn();
+                    promise.Set({});
+                } else {
+                    promise.Set(fn());
+                }
+            },
+            token, priority);
+        return future;
+    }
+
+    // Calls `fn(i)` for every i in `range` and returns once all calls have
+    // finished. The calling thread works alongside the pool, so this may also
+    // be called from inside a pool task.
+    //
+    // Indices are handed out in chunks that start large and shrink as the
+    // range drains (guided self-scheduling), which keeps scheduling overhead
+    // low without leaving one thread with a long tail. Chunks are never
+    // smaller than `grain`; `grain` <= 0 picks a minimum from the range and
+    // pool size.
+    //
+    // Once `token` is cancelled no new chunks are started; the call returns
+    // as soon as the chunks already running have finished.
+    //
+    // Helper tasks run at the priority of the pool task calling ParallelFor,
+    // or Priority::kNormal when called from outside the pool.
+    template <typename Fn>
+    void ParallelFor(
+        IndexRange range, int64_t grain, Fn fn,
+        const CancellationToken &token = CancellationToken::Never()) {
+        auto chunk = [&fn](int, int64_t begin, int64_t end) {
+            for (int64_t i = begin; i < end; ++i) {
+                fn(i);
+            }
+        };
+        RunChunks(range, grain, chunk, token);
+    }
+
+    // Returns the reduction of `map(i)` over `range` with `combine`, which
+    // must be associative and have `identity` as its neutral element.
+    //
+    // Each participating thread folds into its own cache-line padded partial
+    // result and the partials are combined once at the end, so the hot path
+    // takes no locks. Chunking and cancellation work as in ParallelFor; a
+    // cancelled reduction returns the reduction of the chunks that ran.
+    template <typename T, typename Map, typename Combine>
+    T ParallelReduce(
+        IndexRange range, T identity, Map map, Combine combine,
+        int64_t grain = 0,
+        const CancellationToken &token = CancellationToken::Never()) {
+        std::vector<Padded<T>> partials(num_threads_ + 1, Padded<T>{identity});
+        auto chunk = [&](int participant, int64_t begin, int64_t end) {
+            T acc = identity;
+            for (int64_t i = begin; i < end; ++i) {
+                acc = combine(std::move(acc), map(i));
+            }
+            T &partial = partials[participant].value;
+            partial = combine(std::move(partial), std::move(acc));
+        };
+        RunChunks(range, grain, chunk, token);
+
+        T result = std::move(identity);
+        for (Padded<T> &partial : partials) {
+            result = combine(std::move(result), std::move(partial.value));
+        }
+        return result;
+    }
+
+   private:
+    struct Task {
+        Task(absl::AnyInvocable<void()> fn, CancellationToken token,
+             int64_t scheduled_ns)
+            : fn(std::move(fn)),
+              token(std::move(token)),
+              scheduled_ns(scheduled_ns) {}
+
+        absl::AnyInvocable<void()> fn;
+        CancellationToken token;
+        // NowNanos() when the task was scheduled, or 0 if its queue wait
+        // isn't sampled.
+        int64_t scheduled_ns;
+    };
+
+    template <typename T>
+    struct alignas(64) Padded {
+        T value;
+    };
+
+    // Shared by the threads of one ParallelFor/ParallelReduce. Helper tasks
+    // hold a reference so that a helper that only starts after the call
+    // returned finds the range drained and touches nothing else.
+    struct ChunkState {
+        ChunkState(IndexRange range, int64_t grain, int participants,
+                   absl::FunctionRef<void(int, int64_t, int64_t)> run,
+                   CancellationToken token)
+            : next(range.begin),
+              end(range.end),
+              grain(grain),
+              participants(participants),
+              remaining(range.size()),
+              run(run),
+              token(std::move(token)) {}
+
+        // Counts `n` indices as finished (or skipped).
+        void Finish(int64_t n) {
+            if (remaining.fetch_sub(n, std::memory_order_acq_rel) == n) {
+                done.Notify();
+            }
+        }
+
+        // Claims and runs chunks until the range is drained. `run` is only
+        // called while a chunk is claimed, i.e. before `done` is notified.
+        void Work(int participant) {
+            while (true) {
+                if (token.IsCancelled()) {
+                    // Claim everything left so nobody starts another chunk.
+                    const int64_t begin =
+                        next.exchange(end, std::memory_order_relaxed);
+                    if (begin < end) {
+                        Finish(end - begin);
+                    }
+                    return;
+                }
+                int64_t begin = next.load(std::memory_order_relaxed);
+                int64_t size;
+                do {
+                    if (begin >= end) {
+                        return;
+                    }
+                    size = std::max(grain, (end - begin) / (2 * participants));
+                    size = std::min(size, end - begin);
+                } while (!next.compare_exchange_weak(
+                    begin, begin + size, std::memory_order_relaxed));
+                {
+                    TraceSpan span("ParallelFor chunk", "begin", begin);
+                    run(participant, begin, begin + size);
+                }
+                Finish(size);
+            }
+        }
+
+        std::atomic<int64_t> next;
+        const int64_t end;
+        const int64_t grain;
+        const int participants;
+        std::atomic<int64_t> remaining;
+        const absl::FunctionRef<void(int, int64_t, int64_t)> run;
+        const CancellationToken token;
+        absl::Notification done;
+    };
+
+    // Runs `chunk(participant, begin, end)` over `range` on up to size() + 1
+    // threads, the calling thread being participant 0.
+    template <typename ChunkFn>
+    void RunChunks(IndexRange range, int64_t grain, ChunkFn &chunk,
+                   const CancellationToken &token) {
+        const int64_t total = range.size();
+        if (total == 0) {
+            return;
+        }
+        const int participants =
+            static_cast<int>(std::min<int64_t>(num_threads_ + 1, total));
+        if (grain <= 0) {
+            grain = std::max<int64_t>(1, total / (64 * participants));
+        }
+        auto state = std::make_shared<ChunkState>(range, grain, participants,
+                                                  chunk, token);
+        absl::InlinedVector<absl::AnyInvocable<void()>, 16> helpers;
+        for (int p = 1; p < participants; ++p) {
+            helpers.push_back([state, p]() { state->Work(p); });
+        }
+        // Under FullPolicy::kReject some helpers may not fit; the calling
+        // thread picks up their share.
+        const CurrentWorker &current = Current();
+        ScheduleBatch(absl::MakeSpan(helpers), CancellationToken::Never(),
+                      current.pool == this ? current.priority
+                                           : Priority::kNormal);
+        state->Work(0);
+        state->done.WaitForNotification();
+    }
+
+    // Number of rounds an idle worker looks for work before parking.
+    static constexpr int kSpinRounds = 64;
+
+    // One in this many tasks a worker takes is looked for lowest priority
+    // first, so a stream of high priority work can't starve the rest.
+    static constexpr uint32_t kStarvationPeriod = 32;
+
+    // Only written by the owning worker, so updates are relaxed loads and
+    // stores rather than read-modify-writes.
+    struct alignas(64) WorkerCounters {
+        static void Add(std::atomic<int64_t> &counter, int64_t n) {
+            counter.store(counter.load(std::memory_order_relaxed) + n,
+                          std::memory_order_relaxed);
+        }
+
+        std::atomic<int64_t> tasks_executed{0};
+        std::atomic<int64_t> tasks_dropped{0};
+        std::atomic<int64_t> steals{0};
+        std::atomic<int64_t> steal_conflicts{0};
+        std::atomic<int64_t> busy_ns{0};
+        // Start of the current run of back-to-back tasks, or 0 while idle.
+        // Busy time is added to busy_ns per run rather than per task.
+        std::atomic<int64_t> busy_since_ns{0};
+        SingleWriterHistogram queue_wait;
+        SingleWriterHistogram run_time;
+    };
+
+    struct Worker {
+        // Indexed by Priority.
+        std::array<WorkStealingDeque<Task>, kNumPriorities> deques;
+        WorkerCounters counters;
+        // Both guarded by grow_mu_. A retired worker's thread stays joinable
+        // until the slot is reused or the pool is destroyed.
+        std::thread thread;
+        bool running = false;
+    };
+
+    // Identifies the pool worker running on the current thread, if any.
+    struct CurrentWorker {
+        const ThreadPool *pool = nullptr;
+        int index = -1;
+        // Priority of the task the worker is running.
+        Priority priority = Priority::kNormal;
+    };
+
+    // steady_clock is several times cheaper to read than
+    // absl::GetCurrentTimeNanos() and the metrics only need differences.
+    static int64_t NowNanos() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+
+    // Latency histograms record one in kSamplePeriod tasks so that the clock
+    // is read rarely enough to keep the metrics on all the time.
+    static constexpr int kSamplePeriod = 16;
+
+    // Whether the calling thread should timestamp the tasks it is scheduling.
+    static bool SampleSchedule() {
+        thread_local uint32_t calls = 0;
+        return calls++ % kSamplePeriod == 0;
+    }
+
+    static CurrentWorker &Current() {
+        thread_local CurrentWorker current;
+        return current;
+    }
+
+    // Accounts for `n` tasks that were just made visible to the workers and
+    // wakes parked workers to run them.
+    void Published(size_t n) {
+        const int64_t depth =
+            pending_.fetch_add(n, std::memory_order_seq_cst) + n;
+        int64_t peak = peak_pending_.load(std::memory_order_relaxed);
+        while (depth > peak && !peak_pending_.compare_exchange_weak(
+                                   peak, depth, std::memory_order_relaxed)) {
+        }
+        if (elastic_) {
+            MaybeGrow(depth);
+        }
+        Wake(n);
+    }
+
+    // Adds a worker if none is alive, or if tasks are backing up while every
+    // worker is busy. Pairs with the seq_cst `live_` decrement in Park: a
+    // retiring worker either sees the new task in `pending_` and stays, or
+    // this sees it gone.
+    void MaybeGrow(int64_t depth) {
+        const int live = live_.load(std::memory_order_seq_cst);
+        if (live >= num_threads_) {
+            return;
+        }
+        if (live > 0 && (depth <= live ||
+                         num_sleeping_.load(std::memory_order_relaxed) > 0)) {
+            return;
+        }
+        absl::MutexLock l(&grow_mu_);
+        if (live_.load(std::memory_order_relaxed) < num_threads_ &&
+            !stopping_.load(std::memory_order_relaxed)) {
+            StartWorkerLocked();
+        }
+    }
+
+    // Starts a thread in the first free worker slot.
+    void StartWorkerLocked() ABSL_EXCLUSIVE_LOCKS_REQUIRED(grow_mu_) {
+        for (int i = 0; i < num_threads_; ++i) {
+            Worker &w = *workers_[i];
+            if (w.running) {
+                continue;
+            }
+            // A retired thread has left WorkLoop or is about to.
+            if (w.thread.joinable()) {
+                w.thread.join();
+            }
+            w.running = true;
+            live_.fetch_add(1, std::memory_order_seq_cst);
+            w.thread = std::thread(&ThreadPool::WorkLoop, this, i);
+            return;
+        }
+    }
+
+    // Locks the park mutex, counting acquisitions that have to wait.
+    void LockParkMutex() ABSL_EXCLUSIVE_LOCK_FUNCTION(sleep_mu_) {
+        if (!sleep_mu_.TryLock()) {
+            park_lock_contended_.fetch_add(1, std::memory_order_relaxed);
+            sleep_mu_.Lock();
+        }
+    }
+
+    // Wakes up to `n` parked workers.
+    void Wake(size_t n) {
+        if (num_sleeping_.load(std::memory_order_seq_cst) > 0) {
+            LockParkMutex();
+            if (n == 1) {
+                sleep_cv_.Signal();
+            } else {
+                sleep_cv_.SignalAll();
+            }
+            sleep_mu_.Unlock();
+        }
+    }
+
+    // Pushes `tasks` into the injection ring of priority `level` and returns
+    // how many made it.
+    size_t Inject(int level, absl::Span<Task *const> tasks) {
+        BoundedMpmcQueue<Task *> &ring = *injection_[level];
+        size_t pushed = ring.TryPushBatch(tasks);
+        if (pushed > 0) {
+            Published(pushed);
+        }
+        if (pushed < tasks.size()) {
+            injection_full_.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (full_policy_ == FullPolicy::kReject) {
+            return pushed;
+        }
+        absl::Duration backoff = absl::Microseconds(1);
+        while (pushed < tasks.size()) {
+            absl::SleepFor(backoff);
+            backoff = std::min(backoff * 2, absl::Milliseconds(1));
+            const size_t more = ring.TryPushBatch(tasks.subspan(pushed));
+            if (more > 0) {
+                Published(more);
+                pushed += more;
+            }
+        }
+        return pushed;
+    }
+
+    // Looks for a task of priority `level`: the worker's own deque, then the
+    // injection ring, then the other workers' deques. Pop and Steal each cost
+    // a full fence, so deques that look empty are skipped; with several
+    // priority levels most of them are.
+    Task *FindTaskAt(int level, int self, uint64_t &rng,
+                     WorkerCounters &counters) {
+        WorkStealingDeque<Task> &own = workers_[self]->deques[level];
+        if (!own.Empty()) {
+            if (Task *task = own.Pop()) {
+                return task;
+            }
+        }
+        Task *task;
+        if (injection_[level]->TryPop(task)) {
+            return task;
+        }
+        // xorshift64 to pick where to start stealing.
+        rng ^= rng << 13;
+        rng ^= rng >> 7;
+        rng ^= rng << 17;
+        const int start = rng % num_threads_;
+        for (int i = 0; i < num_threads_; ++i) {
+            const int victim = (start + i) % num_threads_;
+            if (victim == self) {
+                continue;
+            }
+            WorkStealingDeque<Task> &deque = workers_[victim]->deques[level];
+            if (deque.Empty()) {
+                continue;
+            }
+            if (Task *task = deque.Steal()) {
+                WorkerCounters::Add(counters.steals, 1);
+                return task;
+            }
+            if (!deque.Empty()) {
+                WorkerCounters::Add(counters.steal_conflicts, 1);
+            }
+        }
+        return nullptr;
+    }
+
+    // Looks for a task from the highest priority down, or from the lowest up
+    // if `lowest_first`. Sets `priority` to the level the task came from.
+    Task *FindTask(int self, uint64_t &rng, WorkerCounters &counters,
+                   bool lowest_first, Priority &priority) {
+        for (int i = 0; i < kNumPriorities; ++i) {
+            const int level = lowest_first ? i : kNumPriorities - 1 - i;
+            if (Task *task = FindTaskAt(level, self, rng, counters)) {
+                priority = static_cast<Priority>(level);
+                return task;
+            }
+        }
+        return nullptr;
+    }
+
+    // Blocks until there may be work. Returns false once the pool is
+    // stopping and every scheduled task has been taken, or when an elastic
+    // pool retires worker `self` after idle_timeout without work.
+    bool Park(int self) {
+        LockParkMutex();
+        num_sleeping_.fetch_add(1, std::memory_order_seq_cst);
+        // `pending_` can briefly dip below zero when a worker takes a task
+        // before its producer got to count it.
+        while (pending_.load(std::memory_order_seq_cst) <= 0 &&
+               !stopping_.load(std::memory_order_seq_cst)) {
+            if (!elastic_) {
+                sleep_cv_.Wait(&sleep_mu_);
+                continue;
+            }
+            if (sleep_cv_.WaitWithTimeout(&sleep_mu_, idle_timeout_) &&
+                TryRetire(self)) {
+                num_sleeping_.fetch_sub(1, std::memory_order_relaxed);
+                sleep_mu_.Unlock();
+                return false;
+            }
+        }
+        num_sleeping_.fetch_sub(1, std::memory_order_relaxed);
+        sleep_mu_.Unlock();
+        return pending_.load(std::memory_order_seq_cst) > 0;
+    }
+
+    // Frees worker `self`'s slot unless that would go below min_threads or
+    // work has arrived meanwhile. The worker's deques are empty: it only
+    // parks after failing to pop from them, and only it pushes to them.
+    bool TryRetire(int self) {
+        absl::MutexLock l(&grow_mu_);
+        if (live_.load(std::memory_order_relaxed) <= min_threads_) {
+            return false;
+        }
+        live_.fetch_sub(1, std::memory_order_seq_cst);
+        if (pending_.load(std::memory_order_seq_cst) > 0 ||
+            stopping_.load(std::memory_order_seq_cst)) {
+            live_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        workers_[self]->running = false;
+        return true;
+    }
+
+    void WorkLoop(int self) {
+        if (!worker_cpus_.empty()) {
+            // Best effort: an unpinned worker still runs correctly.
+            PinCurrentThread(worker_cpus_[self]);
+        }
+        SetTraceThreadName("pool worker " + std::to_string(self));
+        CurrentWorker &current = Current();
+        current = {this, self};
+        WorkerCounters &counters = workers_[self]->counters;
+        uint64_t rng = 0x9e3779b97f4a7c15ULL * (self + 1);
+        int idle_rounds = 0;
+        uint32_t taken = 0;
+        uint32_t executed = 0;
+        int64_t busy_since = 0;
+        while (true) {
+            Task *task =
+                FindTask(self, rng, counters,
+                         taken % kStarvationPeriod == kStarvationPeriod - 1,
+                         current.priority);
+            if (task != nullptr) {
+                ++taken;
+                pending_.fetch_sub(1, std::memory_order_relaxed);
+                if (busy_since == 0) {
+                    busy_since = NowNanos();
+                    counters.busy_since_ns.store(busy_since,
+                                                 std::memory_order_relaxed);
+                }
+                if (task->scheduled_ns != 0) {
+                    counters.queue_wait.Record(NowNanos() - task->scheduled_ns);
+                }
+                if (task->token.IsCancelled()) {
+                    WorkerCounters::Add(counters.tasks_dropped, 1);
+                } else {
+                    TraceSpan span("ThreadPool task", "priority",
+                                   static_cast<int>(current.priority));
+                    if (executed++ % kSamplePeriod == 0) {
+                        const int64_t start = NowNanos();
+                        task->fn();
+                        counters.run_time.Record(NowNanos() - start);
+                    } else {
+                        task->fn();
+                    }
+                    WorkerCounters::Add(counters.tasks_executed, 1);
+                }
+                ObjectPool<Task>::Delete(task);
+                idle_rounds = 0;
+                continue;
+            }
+            if (busy_since != 0) {
+                // Clear the start first: a concurrent Stats() may miss this
+                // run for a moment but never counts it twice.
+                counters.busy_since_ns.store(0, std::memory_order_relaxed);
+                counters.busy_ns.store(
+                    counters.busy_ns.load(std::memory_order_relaxed) +
+                        NowNanos() - busy_since,
+                    std::memory_order_release);
+                busy_since = 0;
+            }
+            if (++idle_rounds < kSpinRounds) {
+                std::this_thread::yield();
+                continue;
+            }
+            idle_rounds = 0;
+            if (!Park(self)) {
+                break;
+            }
+        }
+        Current() = {};
+    }
+
+    const int num_threads_;
+    const FullPolicy full_policy_;
+    // CPU each worker is pinned to; empty when not pinning.
+    const std::vector<int> worker_cpus_;
+    const bool elastic_;
+    const int min_threads_;
+    const absl::Duration idle_timeout_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    // Indexed by Priority.
+    std::array<std::unique_ptr<BoundedMpmcQueue<Task *>>, kNumPriorities>
+        injection_;
+
+    // Tasks scheduled but not yet taken by a worker.
+    std::atomic<int64_t> pending_{0};
+    std::atomic<int64_t> peak_pending_{0};
+    std::atomic<int64_t> injection_full_{0};
+    std::atomic<int64_t> park_lock_contended_{0};
+    std::atomic<int> num_sleeping_{0};
+    std::atomic<bool> stopping_{false};
+    absl::Mutex sleep_mu_;
+    absl::CondVar sleep_cv_;
+
+    // Held while starting or retiring workers. May be taken with sleep_mu_
+    // held, never the other way around.
+    absl::Mutex grow_mu_ ABSL_ACQUIRED_AFTER(sleep_mu_);
+    std::atomic<int> live_{0};
+
+    const absl::Time start_;
+    absl::Notification stop_logging_;
+    std::thread stats_logger_;
+};
+
+}  // namespace common
@@ -0,0 +1,191 @@
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <queue>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/functional/any_invocable.h"
+#include "absl/strings/str_format.h"
+#include "absl/synchronization/blocking_counter.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
+#include "thread_pool.h"
+
+ABSL_FLAG(int64_t, tasks, 1'000'000, "Number of tasks per measurement.");
+ABSL_FLAG(int, max_threads, 64, "Largest pool size to measure.");
+ABSL_FLAG(int, work, 100, "Loop iterations of busy work per task.");
+ABSL_FLAG(bool, stats, false,
+          "Print the work-stealing pool's metrics after each measurement.");
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// The previous common::ThreadPool: one std::queue behind one mutex. Kept
+// here as the baseline to compare against.
+class MutexQueuePool {
+   public:
+    explicit MutexQueuePool(int num_threads) {
+        for (int i = 0; i < num_threads; ++i) {
+            threads_.push_back(std::thread(&MutexQueuePool::WorkLoop, this));
+        }
+    }
+
+    ~MutexQueuePool() {
+        {
+            absl::MutexLock l(&mu_);
+            for (size_t i = 0; i < threads_.size(); i++) {
+                queue_.push(nullptr);
+            }
+        }
+        for (auto &t : threads_) {
+            t.join();
+        }
+    }
+
+    void Schedule(absl::AnyInvocable<void()> func) {
+        absl::MutexLock l(&mu_);
+        queue_.push(std::move(func));
+    }
+
+   private:
+    bool WorkAvailable() const { return !queue_.empty(); }
+
+    void WorkLoop() {
+        while (true) {
+            absl::AnyInvocable<void()> func;
+            {
+                absl::MutexLock l(&mu_);
+                mu_.Await(absl::Condition(this, &MutexQueuePool::WorkAvailable));
+                func = std::move(queue_.front());
+                queue_.pop();
+            }
+            if (func == nullptr) {
+                break;
+            }
+            func();
+        }
+    }
+
+    absl::Mutex mu_;
+    std::queue<absl::AnyInvocable<void()>> queue_;
+    std::vector<std::thread> threads_;
+};
+
+std::atomic<uint64_t> sink{0};
+
+void BusyWork(int iterations) {
+    uint64_t x = iterations;
+    for (int i = 0; i < iterations; ++i) {
+        x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+    }
+    sink.fetch_add(x, std::memory_order_relaxed);
+}
+
+// Every task is scheduled from the main thread.
+template <typename Pool>
+double Flat(Pool &pool, int64_t tasks, int work) {
+    absl::BlockingCounter counter(tasks);
+    const Clock::time_point start = Clock::now();
+    for (int64_t i = 0; i < tasks; ++i) {
+        pool.Schedule([&counter, work]() {
+            BusyWork(work);
+            counter.DecrementCount();
+        });
+    }
+    counter.Wait();
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Like Flat, but submitted in batches of `batch` tasks through
+// ScheduleBatch.
+double FlatBatch(common::ThreadPool &pool, int64_t tasks, int work,
+                 int batch) {
+    absl::BlockingCounter counter(tasks);
+    std::vector<absl::AnyInvocable<void()>> funcs;
+    const Clock::time_point start = Clock::now();
+    for (int64_t i = 0; i < tasks; i += batch) {
+        funcs.clear();
+        for (int64_t j = i; j < std::min<int64_t>(tasks, i + batch); ++j) {
+            funcs.push_back([&counter, work]() {
+                BusyWork(work);
+                counter.DecrementCount();
+            });
+        }
+        pool.ScheduleBatch(absl::MakeSpan(funcs));
+    }
+    counter.Wait();
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Tasks recursively split into two until they are a single unit of work, the
+// shape of a per-subtree search.
+template <typename Pool>
+void Split(Pool &pool, int64_t n, int work, absl::BlockingCounter &counter) {
+    while (n > 1) {
+        const int64_t half = n / 2;
+        pool.Schedule([&pool, half, work, &counter]() {
+            Split(pool, half, work, counter);
+        });
+        n -= half;
+    }
+    BusyWork(work);
+    counter.DecrementCount();
+}
+
+template <typename Pool>
+double Nested(Pool &pool, int64_t tasks, int work) {
+    absl::BlockingCounter counter(tasks);
+    const Clock::time_point start = Clock::now();
+    pool.Schedule([&pool, tasks, work, &counter]() {
+        Split(pool, tasks, work, counter);
+    });
+    counter.Wait();
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+template <typename Pool>
+void Measure(const std::string &name, int threads, int64_t tasks, int work) {
+    Pool pool(threads);
+    const double flat = Flat(pool, tasks, work);
+    const double nested = Nested(pool, tasks, work);
+    std::string batched = "-";
+    if constexpr (std::is_same_v<Pool, common::ThreadPool>) {
+        batched = absl::StrFormat(
+            "%.0f", tasks / FlatBatch(pool, tasks, work, /*batch=*/1024));
+    }
+    std::cout << absl::StrFormat("%-14s %3d threads  flat %12.0f tasks/s  "
+                                 "batched %12s tasks/s  nested %12.0f tasks/s",
+                                 name, threads, tasks / flat, batched,
+                                 tasks / nested)
+              << std::endl;
+    if constexpr (std::is_same_v<Pool, common::ThreadPool>) {
+        if (absl::GetFlag(FLAGS_stats)) {
+            std::cout << pool.Stats().DebugString();
+        }
+    }
+}
+
+}  // namespace
+
+// Task throughput of common::ThreadPool against a single mutex-protected
+// queue, for 1 to --max_threads threads.
+int main(int argc, char **argv) {
+    absl::ParseCommandLine(argc, argv);
+    const int64_t tasks = absl::GetFlag(FLAGS_tasks);
+    const int work = absl::GetFlag(FLAGS_work);
+    for (int threads = 1; threads <= absl::GetFlag(FLAGS_max_threads);
+         threads *= 2) {
+        Measure<MutexQueuePool>("mutex_queue", threads, tasks, work);
+        Measure<common::ThreadPool>("work_stealing", threads, tasks, work);
+    }
+    return 0;
+}
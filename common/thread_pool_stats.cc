@@ -0,0 +1,89 @@
+#include "thread_pool_stats.h"
+
+#include <cstdint>
+#include <string>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/time/time.h"
+
+namespace common {
+
+int64_t DurationHistogram::count() const {
+    int64_t total = 0;
+    for (int64_t c : counts) {
+        total += c;
+    }
+    return total;
+}
+
+absl::Duration DurationHistogram::Quantile(double quantile) const {
+    const int64_t total = count();
+    if (total == 0) {
+        return absl::ZeroDuration();
+    }
+    const int64_t rank = static_cast<int64_t>(quantile * (total - 1));
+    int64_t seen = 0;
+    for (int i = 0; i < kBuckets; ++i) {
+        seen += counts[i];
+        if (seen > rank) {
+            return absl::Nanoseconds(i == 0 ? 0 : int64_t{1} << i);
+        }
+    }
+    return absl::Nanoseconds(int64_t{1} << (kBuckets - 1));
+}
+
+void DurationHistogram::Merge(const DurationHistogram &other) {
+    for (int i = 0; i < kBuckets; ++i) {
+        counts[i] += other.counts[i];
+    }
+}
+
+int64_t ThreadPoolStats::tasks_executed() const {
+    int64_t total = 0;
+    for (const WorkerStats &worker : workers) {
+        total += worker.tasks_executed;
+    }
+    return total;
+}
+
+namespace {
+
+std::string Summary(const DurationHistogram &histogram) {
+    return absl::StrFormat("n=%d p50<=%s p90<=%s p99<=%s max<=%s",
+                           histogram.count(),
+                           absl::FormatDuration(histogram.Quantile(0.5)),
+                           absl::FormatDuration(histogram.Quantile(0.9)),
+                           absl::FormatDuration(histogram.Quantile(0.99)),
+                           absl::FormatDuration(histogram.Quantile(1.0)));
+}
+
+}  // namespace
+
+std::string ThreadPoolStats::DebugString() const {
+    std::string ret = absl::StrFormat(
+        "thread pool after %s: %d tasks run, queue depth %d (peak %d), "
+        "%d/%d live workers parked\n",
+        absl::FormatDuration(absl::Trunc(uptime, absl::Milliseconds(1))),
+        tasks_executed(), queue_depth, peak_queue_depth, parked_workers,
+        live_workers);
+    absl::StrAppend(&ret, "  queue wait: ", Summary(queue_wait), "\n");
+    absl::StrAppend(&ret, "  run time:   ", Summary(run_time), "\n");
+    absl::StrAppendFormat(&ret,
+                          "  contention: %d injection ring full, %d park lock "
+                          "waits\n",
+                          injection_full, park_lock_contended);
+    for (size_t i = 0; i < workers.size(); ++i) {
+        const WorkerStats &w = workers[i];
+        const double total = absl::ToDoubleSeconds(w.busy + w.idle);
+        absl::StrAppendFormat(
+            &ret,
+            "  worker %2d: %10d run %8d dropped %8d steals (%d lost) "
+            "busy %5.1f%%\n",
+            i, w.tasks_executed, w.tasks_dropped, w.steals, w.steal_conflicts,
+            total > 0 ? 100 * absl::ToDoubleSeconds(w.busy) / total : 0.0);
+    }
+    return ret;
+}
+
+}  // namespace common
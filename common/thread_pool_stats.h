@@ -0,0 +1,101 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "absl/time/time.h"
+
+namespace common {
+
+// Counts of durations in power-of-two nanosecond buckets. Bucket 0 holds
+// durations below 1ns, bucket b > 0 those in [2^(b-1), 2^b) ns.
+struct DurationHistogram {
+    static constexpr int kBuckets = 48;
+
+    static int Bucket(int64_t nanos) {
+        if (nanos <= 0) {
+            return 0;
+        }
+        const int bucket = 64 - std::countl_zero(static_cast<uint64_t>(nanos));
+        return bucket < kBuckets ? bucket : kBuckets - 1;
+    }
+
+    int64_t count() const;
+
+    // Upper bound of the bucket holding the `quantile` (in [0, 1]) sample.
+    absl::Duration Quantile(double quantile) const;
+
+    void Merge(const DurationHistogram &other);
+
+    std::array<int64_t, kBuckets> counts{};
+};
+
+// DurationHistogram recorded by a single thread and read by any. The writer
+// uses plain relaxed loads and stores, never read-modify-writes.
+class SingleWriterHistogram {
+   public:
+    void Record(int64_t nanos) {
+        std::atomic<int64_t> &bucket =
+            buckets_[DurationHistogram::Bucket(nanos)];
+        bucket.store(bucket.load(std::memory_order_relaxed) + 1,
+                     std::memory_order_relaxed);
+    }
+
+    void AddTo(DurationHistogram &histogram) const {
+        for (int i = 0; i < DurationHistogram::kBuckets; ++i) {
+            histogram.counts[i] += buckets_[i].load(std::memory_order_relaxed);
+        }
+    }
+
+   private:
+    std::array<std::atomic<int64_t>, DurationHistogram::kBuckets> buckets_{};
+};
+
+// Per-worker counters, only written by their worker.
+struct WorkerStats {
+    int64_t tasks_executed = 0;
+    // Tasks taken from a queue but not run because they were cancelled.
+    int64_t tasks_dropped = 0;
+    int64_t steals = 0;
+    // Steals from a non-empty victim that lost the race for its oldest task.
+    int64_t steal_conflicts = 0;
+    // Time spent running or looking for the next task while there was work,
+    // and the rest of the pool's uptime. Busy includes the worker's current
+    // run of tasks, up to the snapshot.
+    absl::Duration busy;
+    absl::Duration idle;
+};
+
+// Point-in-time view of a ThreadPool, from ThreadPool::Stats().
+struct ThreadPoolStats {
+    absl::Duration uptime;
+    // Tasks scheduled but not yet taken by a worker.
+    int64_t queue_depth = 0;
+    int64_t peak_queue_depth = 0;
+    int64_t parked_workers = 0;
+    // Running workers; below workers.size() for an elastic pool.
+    int64_t live_workers = 0;
+
+    // Contention: producers that found the injection ring full (and waited or
+    // were rejected), and acquisitions of the park mutex that had to block.
+    int64_t injection_full = 0;
+    int64_t park_lock_contended = 0;
+
+    // Time from Schedule to a worker taking the task, and time spent running
+    // it. Both are sampled, so their counts are a fraction of the tasks run.
+    DurationHistogram queue_wait;
+    DurationHistogram run_time;
+
+    std::vector<WorkerStats> workers;
+
+    int64_t tasks_executed() const;
+
+    // Multi-line human-readable report.
+    std::string DebugString() const;
+};
+
+}  // namespace common
@@ -0,0 +1,229 @@
+#include "trace.h"
+
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/synchronization/mutex.h"
+
+namespace common {
+
+namespace trace_internal {
+
+std::atomic<bool> enabled{false};
+
+}  // namespace trace_internal
+
+namespace {
+
+// 2.5MiB per thread that records while tracing is on.
+constexpr uint64_t kSpansPerThread = 1 << 16;
+
+struct Span {
+    const char *name;
+    const char *arg_name;
+    int64_t arg;
+    int64_t start_ns;
+    int64_t end_ns;
+};
+
+// Written only by the thread that owns it. Kept until exit, so the spans of
+// threads that have finished are still written.
+struct ThreadBuffer {
+    std::unique_ptr<Span[]> spans{new Span[kSpansPerThread]};
+    // Spans ever recorded; the next one goes to recorded % kSpansPerThread.
+    std::atomic<uint64_t> recorded{0};
+    // Set while the owner writes a span, so that WriteTrace can wait for it.
+    std::atomic<bool> writing{false};
+};
+
+// A thread's trace id and buffer; the buffer is created on its first span.
+struct TraceThread {
+    int tid = -1;
+    ThreadBuffer *buffer = nullptr;
+};
+
+absl::Mutex trace_mu(absl::kConstInit);
+int64_t trace_start_ns ABSL_GUARDED_BY(trace_mu) = 0;
+
+// Every buffer with the tid it is written under.
+std::vector<std::pair<int, ThreadBuffer *>> &Buffers()
+    ABSL_EXCLUSIVE_LOCKS_REQUIRED(trace_mu) {
+    static auto *buffers = new std::vector<std::pair<int, ThreadBuffer *>>();
+    return *buffers;
+}
+
+// Indexed by tid.
+std::vector<std::string> &ThreadNames() ABSL_EXCLUSIVE_LOCKS_REQUIRED(
+    trace_mu) {
+    static auto *names = new std::vector<std::string>();
+    return *names;
+}
+
+// Ids and buffers of named threads that have exited, by name. A new thread
+// taking the same name, e.g. a restarted pool worker, carries on with them
+// rather than allocating another buffer.
+absl::flat_hash_map<std::string, std::vector<TraceThread>> &Exited()
+    ABSL_EXCLUSIVE_LOCKS_REQUIRED(trace_mu) {
+    static auto *exited =
+        new absl::flat_hash_map<std::string, std::vector<TraceThread>>();
+    return *exited;
+}
+
+// Hands the thread's id and buffer over to Exited() when the thread ends.
+struct ThreadState {
+    ~ThreadState() {
+        if (thread.tid < 0) {
+            return;
+        }
+        absl::MutexLock l(&trace_mu);
+        const std::string &name = ThreadNames()[thread.tid];
+        if (!name.empty()) {
+            Exited()[name].push_back(thread);
+        }
+    }
+
+    TraceThread thread;
+};
+
+TraceThread &CurrentThread() {
+    thread_local ThreadState state;
+    return state.thread;
+}
+
+// The calling thread's trace id, assigned on first use.
+int CurrentTid() {
+    TraceThread &thread = CurrentThread();
+    if (thread.tid < 0) {
+        absl::MutexLock l(&trace_mu);
+        ThreadNames().emplace_back();
+        thread.tid = static_cast<int>(ThreadNames().size()) - 1;
+    }
+    return thread.tid;
+}
+
+ThreadBuffer *CurrentBuffer() {
+    TraceThread &thread = CurrentThread();
+    if (thread.buffer == nullptr) {
+        const int tid = CurrentTid();
+        thread.buffer = new ThreadBuffer();
+        absl::MutexLock l(&trace_mu);
+        Buffers().emplace_back(tid, thread.buffer);
+    }
+    return thread.buffer;
+}
+
+}  // namespace
+
+namespace trace_internal {
+
+void Record(const char *name, const char *arg_name, int64_t arg,
+            int64_t start_ns, int64_t end_ns) {
+    ThreadBuffer *buffer = CurrentBuffer();
+    // Pairs with WriteTrace, which clears `enabled` and then waits for
+    // `writing` to drop: either it sees this write in progress, or this
+    // sees tracing stopped.
+    buffer->writing.store(true, std::memory_order_seq_cst);
+    if (enabled.load(std::memory_order_seq_cst)) {
+        const uint64_t n = buffer->recorded.load(std::memory_order_relaxed);
+        buffer->spans[n % kSpansPerThread] = {name, arg_name, arg, start_ns,
+                                              end_ns};
+        buffer->recorded.store(n + 1, std::memory_order_relaxed);
+    }
+    buffer->writing.store(false, std::memory_order_release);
+}
+
+}  // namespace trace_internal
+
+void StartTracing() {
+    absl::MutexLock l(&trace_mu);
+    if (trace_start_ns == 0) {
+        trace_start_ns = trace_internal::NowNanos();
+    }
+    trace_internal::enabled.store(true, std::memory_order_relaxed);
+}
+
+void SetTraceThreadName(std::string name) {
+    TraceThread &thread = CurrentThread();
+    absl::MutexLock l(&trace_mu);
+    if (thread.tid < 0) {
+        auto it = Exited().find(name);
+        if (it != Exited().end()) {
+            thread = it->second.back();
+            it->second.pop_back();
+            if (it->second.empty()) {
+                Exited().erase(it);
+            }
+            return;
+        }
+        ThreadNames().emplace_back();
+        thread.tid = static_cast<int>(ThreadNames().size()) - 1;
+    }
+    ThreadNames()[thread.tid] = std::move(name);
+}
+
+bool WriteTrace(const std::string &path) {
+    trace_internal::enabled.store(false, std::memory_order_seq_cst);
+    absl::MutexLock l(&trace_mu);
+    // Spans still being recorded finish within a few stores.
+    for (const auto &[tid, buffer] : Buffers()) {
+        while (buffer->writing.load(std::memory_order_acquire)) {
+            std::this_thread::yield();
+        }
+    }
+    const int pid = getpid();
+    std::string out = R"({"displayTimeUnit": "ns", "traceEvents": [)";
+    const char *separator = "\n";
+    const std::vector<std::string> &names = ThreadNames();
+    for (size_t tid = 0; tid < names.size(); ++tid) {
+        if (names[tid].empty()) {
+            continue;
+        }
+        absl::StrAppendFormat(
+            &out,
+            R"(%s{"name": "thread_name", "ph": "M", "pid": %d, "tid": %d, )"
+            R"("args": {"name": "%s"}})",
+            separator, pid, tid, names[tid]);
+        separator = ",\n";
+    }
+    for (const auto &[tid, buffer] : Buffers()) {
+        const uint64_t recorded =
+            buffer->recorded.load(std::memory_order_relaxed);
+        const uint64_t first =
+            recorded > kSpansPerThread ? recorded - kSpansPerThread : 0;
+        for (uint64_t i = first; i < recorded; ++i) {
+            const Span &span = buffer->spans[i % kSpansPerThread];
+            absl::StrAppendFormat(
+                &out,
+                R"(%s{"name": "%s", "ph": "X", "pid": %d, "tid": %d, )"
+                R"("ts": %.3f, "dur": %.3f)",
+                separator, span.name, pid, tid,
+                (span.start_ns - trace_start_ns) / 1e3,
+                (span.end_ns - span.start_ns) / 1e3);
+            if (span.arg_name != nullptr) {
+                absl::StrAppendFormat(&out, R"(, "args": {"%s": %d})",
+                                      span.arg_name, span.arg);
+            }
+            out.push_back('}');
+            separator = ",\n";
+        }
+    }
+    absl::StrAppend(&out, "\n]}\n");
+    std::ofstream file(path, std::ios::trunc);
+    file << out;
+    file.close();
+    return file.good();
+}
+
+}  // namespace common
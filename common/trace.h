@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace common {
+
+// Timeline of scoped spans, written in Chrome's trace_event JSON format for
+// Perfetto (ui.perfetto.dev) or chrome://tracing.
+//
+// Each thread records into its own fixed-size ring buffer without locks,
+// overwriting its oldest spans once full. Tracing is off until StartTracing();
+// until then a TraceSpan costs a relaxed load and a branch.
+
+// Starts recording spans. Timestamps in the trace count from the first call.
+void StartTracing();
+
+// Stops recording and writes every buffered span to `path`. Spans still
+// being recorded are waited for; spans that end later are dropped. Returns
+// false if the file can't be written.
+bool WriteTrace(const std::string &path);
+
+// Names the calling thread in traces. Threads without a name show their id.
+// A thread that takes the name of a thread that has exited, e.g. a restarted
+// pool worker, continues that thread's timeline and reuses its buffer.
+void SetTraceThreadName(std::string name);
+
+namespace trace_internal {
+
+extern std::atomic<bool> enabled;
+
+inline int64_t NowNanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+void Record(const char *name, const char *arg_name, int64_t arg,
+            int64_t start_ns, int64_t end_ns);
+
+}  // namespace trace_internal
+
+inline bool TracingEnabled() {
+    return trace_internal::enabled.load(std::memory_order_relaxed);
+}
+
+// Records the lifetime of the object as one span on the calling thread, with
+// an optional integer argument. `name` and `arg_name` must outlive the
+// trace; string literals are the intended use.
+class TraceSpan {
+   public:
+    explicit TraceSpan(const char *name, const char *arg_name = nullptr,
+                       int64_t arg = 0)
+        : name_(name),
+          arg_name_(arg_name),
+          arg_(arg),
+          start_ns_(TracingEnabled() ? trace_internal::NowNanos() : 0) {}
+
+    TraceSpan(const TraceSpan &) = delete;
+    TraceSpan &operator=(const TraceSpan &) = delete;
+
+    ~TraceSpan() {
+        if (start_ns_ != 0) {
+            trace_internal::Record(name_, arg_name_, arg_, start_ns_,
+                                   trace_internal::NowNanos());
+        }
+    }
+
+   private:
+    const char *const name_;
+    const char *const arg_name_;
+    const int64_t arg_;
+    // 0 if tracing was off when the span started.
+    const int64_t start_ns_;
+};
+
+}  // namespace common
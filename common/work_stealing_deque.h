@@ -0,0 +1,123 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace common {
+
+// Chase-Lev work-stealing deque of pointers, following the C11 formulation in
+// "Correct and Efficient Work-Stealing for Weak Memory Models" (Lê et al.,
+// PPoPP 2013).
+//
+// The owning thread pushes and pops at the bottom; any other thread may steal
+// from the top. Push and Pop are wait-free for the owner except when the
+// buffer grows. Old buffers are kept until the deque is destroyed because a
+// concurrent thief may still be reading from them.
+template <typename T>
+class WorkStealingDeque {
+   public:
+    explicit WorkStealingDeque(int log_capacity = 8)
+        : array_(new Array(int64_t{1} << log_capacity)) {
+        retired_.emplace_back(array_.load(std::memory_order_relaxed));
+    }
+
+    WorkStealingDeque(const WorkStealingDeque &) = delete;
+    WorkStealingDeque &operator=(const WorkStealingDeque &) = delete;
+
+    // Owner only.
+    void Push(T *item) {
+        const int64_t b = bottom_.load(std::memory_order_relaxed);
+        const int64_t t = top_.load(std::memory_order_acquire);
+        Array *a = array_.load(std::memory_order_relaxed);
+        if (b - t > a->capacity - 1) {
+            a = Grow(a, t, b);
+        }
+        a->Put(b, item);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom_.store(b + 1, std::memory_order_relaxed);
+    }
+
+    // Owner only. Returns the most recently pushed item, or nullptr.
+    T *Pop() {
+        const int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+        Array *a = array_.load(std::memory_order_relaxed);
+        bottom_.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top_.load(std::memory_order_relaxed);
+        if (t > b) {
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        T *item = a->Get(b);
+        if (t == b) {
+            // Last item: race against thieves for it.
+            if (!top_.compare_exchange_strong(t, t + 1,
+                                              std::memory_order_seq_cst,
+                                              std::memory_order_relaxed)) {
+                item = nullptr;
+            }
+            bottom_.store(b + 1, std::memory_order_relaxed);
+        }
+        return item;
+    }
+
+    // Any thread. Returns the oldest item, or nullptr if the deque is empty
+    // or another thread won the race for it.
+    T *Steal() {
+        int64_t t = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const int64_t b = bottom_.load(std::memory_order_acquire);
+        if (t >= b) {
+            return nullptr;
+        }
+        Array *a = array_.load(std::memory_order_acquire);
+        T *item = a->Get(t);
+        if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                          std::memory_order_relaxed)) {
+            return nullptr;
+        }
+        return item;
+    }
+
+    // Racy snapshot, only suitable as a hint.
+    bool Empty() const {
+        return bottom_.load(std::memory_order_relaxed) <=
+               top_.load(std::memory_order_relaxed);
+    }
+
+   private:
+    struct Array {
+        explicit Array(int64_t cap)
+            : capacity(cap), slots(new std::atomic<T *>[cap]) {}
+
+        T *Get(int64_t i) const {
+            return slots[i & (capacity - 1)].load(std::memory_order_relaxed);
+        }
+        void Put(int64_t i, T *item) {
+            slots[i & (capacity - 1)].store(item, std::memory_order_relaxed);
+        }
+
+        const int64_t capacity;
+        std::unique_ptr<std::atomic<T *>[]> slots;
+    };
+
+    Array *Grow(Array *old, int64_t t, int64_t b) {
+        Array *bigger = new Array(old->capacity * 2);
+        for (int64_t i = t; i < b; ++i) {
+            bigger->Put(i, old->Get(i));
+        }
+        retired_.emplace_back(bigger);
+        array_.store(bigger, std::memory_order_release);
+        return bigger;
+    }
+
+    alignas(64) std::atomic<int64_t> top_{0};
+    alignas(64) std::atomic<int64_t> bottom_{0};
+    std::atomic<Array *> array_;
+    // Every array ever allocated, owned here. Only touched by the owner.
+    std::vector<std::unique_ptr<Array>> retired_;
+};
+
+}  // namespace common
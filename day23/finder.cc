@@ -1,33 +1,36 @@
 #include "finder.h"
 
+#include <algorithm>
+#include <climits>
 #include <iostream>
 #include <span>
 
 #include "absl/strings/str_cat.h"
-#include "absl/strings/str_split.h"
 #include "absl/container/inlined_vector.h"
 #include "absl/log/check.h"
+#include "executor.h"
+#include "thread_pool.h"
+#include "trace.h"
 
 namespace aoc2022 {
 
 namespace {
 
-std::vector<Type> ParseLine(std::string_view line) {
-    std::vector<std::string_view> parts = absl::StrSplit(line, "");
-    std::vector<Type> to_parts;
-    to_parts.reserve(parts.size());
-    for (std::string_view part : parts) {
-        if (part == "#") {
+Row ParseLine(absl::string_view line) {
+    Row to_parts;
+    to_parts.reserve(line.size());
+    for (const char part : line) {
+        if (part == '#') {
             to_parts.push_back(Type::Blocked);
-        } else if (part == ".") {
+        } else if (part == '.') {
             to_parts.push_back(Type::Empty);
-        } else if (part == "A") {
+        } else if (part == 'A') {
             to_parts.push_back(Type::A);
-        } else if (part == "B") {
+        } else if (part == 'B') {
             to_parts.push_back(Type::B);
-        } else if (part == "C") {
+        } else if (part == 'C') {
             to_parts.push_back(Type::C);
-        } else if (part == "D") {
+        } else if (part == 'D') {
             to_parts.push_back(Type::D);
         } else {
             assert(false);
@@ -53,7 +56,7 @@ std::string TypeToString(const Type t) {
     }
 }
 
-std::string Print(const std::vector<std::vector<Type>>& grid) {
+std::string Print(const Grid& grid) {
     std::string ret;
     for (int i = 0; i < grid.size(); ++i) {
         for (int j = 0; j < grid[i].size(); ++j) {
@@ -81,7 +84,7 @@ std::array<std::pair<int, int>, 4> ValidHomes(const Type t) {
     }
 }
 
-bool Complete(const std::vector<std::vector<Type>>& grid) {
+bool Complete(const Grid& grid) {
     for (const std::pair<int, int>& a_pos : kAHomes) {
         if (grid[a_pos.first][a_pos.second] != Type::A) {
             return false;
@@ -106,7 +109,7 @@ bool Complete(const std::vector<std::vector<Type>>& grid) {
 }
 
 bool MovablePosition(const std::pair<int, int>&& pos, const Type type,
-                     const std::vector<std::vector<Type>>& grid) {
+                     const Grid& grid) {
     const std::array<std::pair<int, int>, 4> homes = ValidHomes(type);
     if (pos.first == homes[3].first && pos.second == homes[3].second) {
         return false;
@@ -131,7 +134,7 @@ bool MovablePosition(const std::pair<int, int>&& pos, const Type type,
 }
 
 std::vector<std::pair<int, int>> MovablePositions(
-    const std::vector<std::vector<Type>>& grid) {
+    const Grid& grid) {
     std::vector<std::pair<int, int>> positions;
     for (int i = 0; i < grid.size(); ++i) {
         for (int j = 0; j < grid[i].size(); ++j) {
@@ -192,7 +195,7 @@ bool InHallway(const std::pair<int, int>& pos) {
 std::optional<std::pair<int, int>> OpenPathHome(
     const std::pair<int, int>& curr,
     const std::array<std::pair<int, int>, 4>& valid_homes,
-    const std::vector<std::vector<Type>>& grid) {
+    const Grid& grid) {
     // If the higher of valid_homes is blocked, then backout early.
     if (grid[valid_homes[0].first][valid_homes[0].second] != Type::Empty) {
         return std::nullopt;
@@ -241,7 +244,7 @@ std::optional<std::pair<int, int>> OpenPathHome(
 
 int Cost(const std::pair<int, int>& destination,
          const std::pair<int, int>& curr,
-         const std::vector<std::vector<Type>>& grid) {
+         const Grid& grid) {
     const int row_diff = std::abs(destination.first - curr.first);
     const int col_diff = std::abs(destination.second - curr.second);
     const Type t = grid[curr.first][curr.second];
@@ -251,7 +254,7 @@ int Cost(const std::pair<int, int>& destination,
 // Assumes `curr` is currently in a burrow.
 absl::InlinedVector<std::pair<int, int>, 7> ValidNext(
     const std::pair<int, int>& curr,
-    const std::vector<std::vector<Type>>& grid) {
+    const Grid& grid) {
     absl::InlinedVector<std::pair<int, int>, 7> ret;
 
     // If `curr` is in the lower burrow and the upper burrow contains a nonempty
@@ -333,10 +336,84 @@ absl::InlinedVector<std::pair<int, int>, 7> ValidNext(
 //  is their destination room and that room contains no amphipods which do not
 //  also have that room as their own destination.
 int Finder::FindMin() {
-    return FindMinFromPosition(grid_);
+    Memo memo(memo_options_);
+    const int min_cost = FindMinFromPosition(grid_, memo);
+    memo_stats_ = {};
+    memo.AddTo(memo_stats_);
+    return min_cost;
 }
 
-int Finder::FindMinFromPosition(std::vector<std::vector<Type>>& grid) {
+namespace {
+
+struct Move {
+    Grid grid;
+    int cost;
+};
+
+// Every grid reachable from `grid` in one move, following the same rules as
+// Finder::FindMinFromPosition.
+std::vector<Move> NextMoves(const Grid& grid) {
+    std::vector<Move> moves;
+    for (const std::pair<int, int>& next : MovablePositions(grid)) {
+        if (InHallway(next)) {
+            const std::optional<std::pair<int, int>> can_go_home =
+                OpenPathHome(next, ValidHomes(grid[next.first][next.second]),
+                             grid);
+            if (!can_go_home.has_value()) {
+                continue;
+            }
+            Move& move =
+                moves.emplace_back(Move{grid, Cost(*can_go_home, next, grid)});
+            std::swap(move.grid[next.first][next.second],
+                      move.grid[can_go_home->first][can_go_home->second]);
+            continue;
+        }
+        for (const std::pair<int, int>& vnp : ValidNext(next, grid)) {
+            Move& move = moves.emplace_back(Move{grid, Cost(vnp, next, grid)});
+            std::swap(move.grid[next.first][next.second],
+                      move.grid[vnp.first][vnp.second]);
+        }
+    }
+    return moves;
+}
+
+}  // namespace
+
+int Finder::ParallelFindMin() {
+    if (Complete(grid_)) {
+        return 0;
+    }
+    std::vector<Move> moves = NextMoves(grid_);
+    std::vector<int> costs(moves.size(), INT_MAX);
+    std::vector<MemoStats> stats(moves.size());
+    common::DefaultExecutor().ParallelFor(
+        common::IndexRange{0, static_cast<int64_t>(moves.size())},
+        /*grain=*/1, [this, &moves, &costs, &stats](int64_t i) {
+            common::TraceSpan span("FindMinFromPosition", "first_move", i);
+            Memo memo(memo_options_);
+            const int recursive_min = FindMinFromPosition(moves[i].grid, memo);
+            if (recursive_min != INT_MAX) {
+                costs[i] = moves[i].cost + recursive_min;
+            }
+            memo.AddTo(stats[i]);
+        });
+    memo_stats_ = {};
+    for (const MemoStats& s : stats) {
+        memo_stats_.states += s.states;
+        memo_stats_.rehashes += s.rehashes;
+        memo_stats_.max_peak_bytes =
+            std::max(memo_stats_.max_peak_bytes, s.max_peak_bytes);
+        memo_stats_.total_peak_bytes += s.total_peak_bytes;
+        memo_stats_.rss_bytes = std::max(memo_stats_.rss_bytes, s.rss_bytes);
+    }
+    int winning_min_cost = INT_MAX;
+    for (const int cost : costs) {
+        winning_min_cost = std::min(winning_min_cost, cost);
+    }
+    return winning_min_cost;
+}
+
+int Finder::FindMinFromPosition(Grid& grid, Memo& memo) {
     if (Complete(grid)) {
         return 0;
     }
@@ -355,17 +432,17 @@ int Finder::FindMinFromPosition(std::vector<std::vector<Type>>& grid) {
             const int cost = Cost(*can_go_home, next, grid);
 
             // Copy the grid and recurse.
-            std::vector<std::vector<Type>> grid_cpy = grid;
+            Grid grid_cpy = grid;
             assert(grid_cpy[can_go_home->first][can_go_home->second] ==
                    Type::Empty);
             std::swap(grid_cpy[next.first][next.second],
                       grid_cpy[can_go_home->first][can_go_home->second]);
-            auto it = grid_costs_.find(grid_cpy);
-            const int recursive_min = it != grid_costs_.end()
-                                          ? it->second
-                                          : FindMinFromPosition(grid_cpy);
-            if (it == grid_costs_.end()) {
-                grid_costs_[grid_cpy] = recursive_min;
+            auto it = memo.costs().find(grid_cpy);
+            const int recursive_min =
+                it != memo.costs().end() ? it->second
+                                         : FindMinFromPosition(grid_cpy, memo);
+            if (it == memo.costs().end()) {
+                memo.Insert(grid_cpy, recursive_min);
             }
             if (recursive_min == INT_MAX) {
                 continue;
@@ -381,16 +458,16 @@ int Finder::FindMinFromPosition(std::vector<std::vector<Type>>& grid) {
             ValidNext(next, grid);
         for (const std::pair<int, int>& vnp : valid_next_positions) {
             const int cost = Cost(vnp, next, grid);
-            std::vector<std::vector<Type>> grid_cpy = grid;
+            Grid grid_cpy = grid;
             assert(grid_cpy[vnp.first][vnp.second] == Type::Empty);
             std::swap(grid_cpy[next.first][next.second],
                       grid_cpy[vnp.first][vnp.second]);
-            auto it = grid_costs_.find(grid_cpy);
-            const int recursive_min = it != grid_costs_.end()
-                                          ? it->second
-                                          : FindMinFromPosition(grid_cpy);
-            if (it == grid_costs_.end()) {
-                grid_costs_[grid_cpy] = recursive_min;
+            auto it = memo.costs().find(grid_cpy);
+            const int recursive_min =
+                it != memo.costs().end() ? it->second
+                                         : FindMinFromPosition(grid_cpy, memo);
+            if (it == memo.costs().end()) {
+                memo.Insert(grid_cpy, recursive_min);
             }
             if (recursive_min == INT_MAX) {
                 continue;
@@ -403,9 +480,45 @@ int Finder::FindMinFromPosition(std::vector<std::vector<Type>>& grid) {
     return winning_min_cost;
 }
 
-Finder::Finder(std::span<const std::string> lines) {
+Finder::Memo::Memo(const MemoOptions& options) : arena_(options.backing) {
+    // Constructed with the arena's allocator, by uses-allocator construction.
+    costs_ = std::pmr::polymorphic_allocator<>(arena_.resource())
+                 .new_object<GridCosts>();
+    if (options.expected_states > 0) {
+        costs_->reserve(options.expected_states);
+    }
+}
+
+Finder::Memo::~Memo() {
+    if (arena_.backing() == common::MemoryBacking::kHeap) {
+        std::pmr::polymorphic_allocator<>(arena_.resource())
+            .delete_object(costs_);
+    }
+    // Otherwise the arena frees the table and every position in it at once,
+    // without visiting them.
+}
+
+void Finder::Memo::Insert(const Grid& grid, int cost) {
+    const size_t capacity = costs_->capacity();
+    (*costs_)[grid] = cost;
+    if (capacity != 0 && costs_->capacity() != capacity) {
+        ++rehashes_;
+    }
+}
+
+void Finder::Memo::AddTo(MemoStats& stats) const {
+    stats.states += costs_->size();
+    stats.rehashes += rehashes_;
+    stats.max_peak_bytes = std::max(stats.max_peak_bytes, arena_.peak_bytes());
+    stats.total_peak_bytes += arena_.peak_bytes();
+    stats.rss_bytes = std::max(stats.rss_bytes, common::ResidentSetBytes());
+}
+
+Finder::Finder(std::span<const absl::string_view> lines,
+               const MemoOptions& memo_options)
+    : memo_options_(memo_options) {
     grid_.reserve(lines.size());
-    for (std::string_view l : lines) {
+    for (absl::string_view l : lines) {
         grid_.push_back(ParseLine(l));
     }
 }
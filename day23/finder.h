@@ -1,8 +1,15 @@
+#include <cstdint>
+#include <functional>
+#include <memory_resource>
 #include <span>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "absl/container/flat_hash_map.h"
+#include "absl/hash/hash.h"
+#include "absl/strings/string_view.h"
+#include "memory_resource.h"
 
 namespace aoc2022 {
 
@@ -32,16 +39,86 @@ enum class Type {
     Blocked = 5,
 };
 
+// Grids use std::pmr vectors so that the positions a search memoizes, and
+// their rows, live in the search's common::MemoArena. Everywhere else they
+// use the default heap.
+using Row = std::pmr::vector<Type>;
+using Grid = std::pmr::vector<Row>;
+
+// How each search allocates its memo of position costs.
+struct MemoOptions {
+    common::MemoryBacking backing = common::MemoryBacking::kHeap;
+    // Positions one search is expected to memoize; its table is reserved for
+    // that many up front. For ParallelFindMin this is per first move.
+    int64_t expected_states = 0;
+};
+
+// Memo use of the last FindMin or ParallelFindMin, summed over its searches.
+struct MemoStats {
+    int64_t states = 0;
+    // Times a table outgrew its capacity and was rehashed. A table's first
+    // allocation, when it grows from empty, has nothing to rehash and isn't
+    // counted.
+    int64_t rehashes = 0;
+    // The most memory one memo took from the heap or the OS at once, and
+    // the sum of that over the searches. Searches of ParallelFindMin overlap,
+    // so neither is the process's high-water mark.
+    int64_t max_peak_bytes = 0;
+    int64_t total_peak_bytes = 0;
+    // Largest process RSS seen when a search finished, memo still alive.
+    int64_t rss_bytes = 0;
+};
+
 class Finder {
    public:
-    explicit Finder(std::span<const std::string> lines);
+    // `lines` need only outlive the constructor.
+    explicit Finder(std::span<const absl::string_view> lines,
+                    const MemoOptions& memo_options = {});
     int FindMin();
 
+    // Same result as FindMin, but searches the subtree below each first move
+    // as its own task on common::DefaultExecutor(), each with its own memo.
+    // The memos don't share positions, so this memoizes about twice as many
+    // as FindMin and only pays off with several cores.
+    int ParallelFindMin();
+
+    const MemoStats& memo_stats() const { return memo_stats_; }
+
    private:
-    int FindMinFromPosition(std::vector<std::vector<Type>>& grid);
-    std::vector<std::vector<Type>> grid_;
+    using GridCosts =
+        absl::flat_hash_map<Grid, int, absl::Hash<Grid>, std::equal_to<Grid>,
+                            std::pmr::polymorphic_allocator<
+                                std::pair<const Grid, int>>>;
+
+    // One search's memo table, allocated with everything it holds from its
+    // own arena. Freed when the search is done, in one go unless the backing
+    // is the heap.
+    class Memo {
+       public:
+        explicit Memo(const MemoOptions& options);
+        Memo(const Memo&) = delete;
+        Memo& operator=(const Memo&) = delete;
+        ~Memo();
+
+        GridCosts& costs() { return *costs_; }
+
+        // Records the cost of finishing from `grid`.
+        void Insert(const Grid& grid, int cost);
+
+        // Adds this memo's numbers to `stats`.
+        void AddTo(MemoStats& stats) const;
+
+       private:
+        common::MemoArena arena_;
+        GridCosts* costs_;
+        int64_t rehashes_ = 0;
+    };
+
+    int FindMinFromPosition(Grid& grid, Memo& memo);
+    Grid grid_;
 
-    absl::flat_hash_map<std::vector<std::vector<Type>>, int> grid_costs_;
+    const MemoOptions memo_options_;
+    MemoStats memo_stats_;
 };
 
 }  // namespace aoc2022
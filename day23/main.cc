@@ -1,31 +1,69 @@
-#include <cassert>
-#include <chrono>
-#include <filesystem>
-#include <fstream>
+#include <cstdint>
 #include <iostream>
+#include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
 #include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
 #include "finder.h"
+#include "mapped_file.h"
+#include "memory_resource.h"
+#include "runner.h"
+
+ABSL_FLAG(common::MemoryBacking, memo, common::MemoryBacking::kHeap,
+          "Memory for each search's memo table: heap, arena (freed in one go "
+          "when the search ends) or huge_pages (an arena in 2MiB pages).");
+ABSL_FLAG(int64_t, expected_states, 0,
+          "Positions each search is expected to memoize. Memo tables are "
+          "reserved for this many up front instead of growing.");
+ABSL_FLAG(bool, memo_stats, false,
+          "Write memo sizes, rehashes and memory use to stderr after each "
+          "run.");
+
+namespace {
+
+// Engine that solves the grid with `find_min`.
+common::Engine FinderEngine(std::string name,
+                            int (aoc2022::Finder::*find_min)()) {
+    auto parse = [find_min](const common::MappedFile& input) {
+        auto finder = std::make_unique<aoc2022::Finder>(
+            input.Lines(),
+            aoc2022::MemoOptions{
+                .backing = absl::GetFlag(FLAGS_memo),
+                .expected_states = absl::GetFlag(FLAGS_expected_states),
+            });
+        return [finder = std::move(finder), find_min] {
+            const int min_cost = (finder.get()->*find_min)();
+            if (absl::GetFlag(FLAGS_memo_stats)) {
+                const aoc2022::MemoStats& stats = finder->memo_stats();
+                std::cerr << absl::StrFormat(
+                    "memo: %d states, %d rehashes, %.1f MiB peak per search, "
+                    "%.1f MiB summed over searches, RSS %.1f MiB\n",
+                    stats.states, stats.rehashes,
+                    stats.max_peak_bytes / 1048576.0,
+                    stats.total_peak_bytes / 1048576.0,
+                    stats.rss_bytes / 1048576.0);
+            }
+            return absl::StrCat(min_cost);
+        };
+    };
+    return common::Engine{.name = std::move(name), .parse = std::move(parse)};
+}
+
+}  // namespace
 
 // Program entry point.
-// Reads infile and parses the text.
-int main() {
-    std::ifstream input;
-    const std::string filepath = absl::StrCat(
-        std::filesystem::current_path().string(), "/", "infile.txt");
-    input.open(filepath);
-    assert(input.is_open());
-    std::vector<std::string> strings;
-    std::string line;
-    while (input) {
-        getline(input, line);
-        strings.push_back(line);
-    }
-    input.close();
-    aoc2022::Finder finder(strings);
-    std::cout << finder.FindMin() << std::endl;
+// Solves --input (infile.txt by default) with the chosen engine.
+int main(int argc, char** argv) {
+    absl::ParseCommandLine(argc, argv);
 
-    return 0;
+    std::vector<common::Engine> engines;
+    engines.push_back(FinderEngine("serial", &aoc2022::Finder::FindMin));
+    engines.push_back(
+        FinderEngine("parallel", &aoc2022::Finder::ParallelFindMin));
+    return common::RunSolver(std::move(engines));
 }
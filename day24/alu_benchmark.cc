@@ -0,0 +1,163 @@
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "alu_engine.h"
+#include "mapped_file.h"
+#include "parser.h"
+
+ABSL_FLAG(std::string, input, "test_in.txt", "ALU program to benchmark on.");
+ABSL_FLAG(uint64_t, seed, 2021, "Seed for every generated input.");
+ABSL_FLAG(int64_t, candidates, 2'000'000,
+          "Number of random 14 digit candidates run through each engine.");
+ABSL_FLAG(int, largest_prefixes, 1,
+          "Number of random prefixes to time LargestModelNumber on. Each one "
+          "scans up to 9^8 suffixes. 0 skips this benchmark.");
+ABSL_FLAG(bool, verify, false,
+          "Only run the differential check of every engine against the "
+          "reference engine and exit non-zero on a mismatch.");
+ABSL_FLAG(int64_t, verify_iterations, 1'000'000,
+          "Number of random (program, registers) cases for the differential "
+          "check.");
+
+namespace aoc2022 {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Times `engine` on `candidates` and returns a checksum of the final z
+// values so engines can be cross checked and the work isn't optimized away.
+int64_t BenchmarkEngine(const AluEngine& engine, const Parser& parser,
+                        absl::Span<const std::array<int, 14>> candidates) {
+    const std::vector<SingleProgram>& programs = parser.programs();
+    int64_t instructions = 0;
+    int64_t checksum = 0;
+    const Clock::time_point start = Clock::now();
+    for (const std::array<int, 14>& digits : candidates) {
+        int64_t x = 0;
+        int64_t y = 0;
+        int64_t z = 0;
+        for (size_t i = 0; i < programs.size(); ++i) {
+            int64_t w = digits[i];
+            if (!engine.run(programs[i], x, y, z, w)) {
+                break;
+            }
+            // A failing stage stops partway, so only count completed ones.
+            instructions += programs[i].instructions().size();
+        }
+        checksum += z;
+    }
+    const double seconds =
+        std::chrono::duration<double>(Clock::now() - start).count();
+    std::cout << absl::StrFormat(
+                     "%-12s %10.3fs %14.0f instructions/s %12.0f "
+                     "candidates/s  checksum %d",
+                     engine.name, seconds, instructions / seconds,
+                     candidates.size() / seconds, checksum)
+              << std::endl;
+    return checksum;
+}
+
+// Number of zero free eight digit suffixes LargestModelNumber looks at
+// before returning `result`.
+int64_t SuffixesScanned(int64_t result) {
+    if (result <= 0) {
+        return 43'046'721;  // 9^8
+    }
+    int64_t rank = 0;
+    int64_t scale = 1;
+    for (int64_t n = result; n > 0; n /= 10, scale *= 9) {
+        rank += (n % 10 - 1) * scale;
+    }
+    return rank + 1;
+}
+
+void BenchmarkLargestModelNumber(Parser& parser, uint64_t seed,
+                                 int num_prefixes) {
+    std::mt19937_64 rng(seed);
+    std::uniform_int_distribution<int64_t> pick(kFirstPrefix, kLastPrefix);
+    for (int i = 0; i < num_prefixes; ++i) {
+        int64_t prefix;
+        do {
+            prefix = pick(rng);
+        } while (absl::StrCat(prefix).find('0') != std::string::npos);
+
+        const Clock::time_point start = Clock::now();
+        const int64_t result = parser.SearchPrefix(prefix);
+        const double seconds =
+            std::chrono::duration<double>(Clock::now() - start).count();
+        std::cout << absl::StrFormat(
+                         "LargestModelNumber prefix %d: %.3fs %12.0f "
+                         "candidates/s  result %d",
+                         prefix, seconds, SuffixesScanned(result) / seconds,
+                         result)
+                  << std::endl;
+    }
+}
+
+}  // namespace
+
+}  // namespace aoc2022
+
+// Benchmarks every ALU engine on seeded inputs. Run with --verify to only
+// check the engines against each other.
+int main(int argc, char** argv) {
+    absl::ParseCommandLine(argc, argv);
+
+    const std::unique_ptr<common::MappedFile> input =
+        common::MappedFile::Open(absl::GetFlag(FLAGS_input));
+    if (input == nullptr || input->contents().empty()) {
+        std::cerr << "Could not read " << absl::GetFlag(FLAGS_input)
+                  << std::endl;
+        return 1;
+    }
+    aoc2022::Parser parser(input->Lines());
+    const uint64_t seed = absl::GetFlag(FLAGS_seed);
+
+    // Never report numbers for an engine that computes the wrong thing.
+    const aoc2022::EngineComparison comparison = aoc2022::CompareEngines(
+        parser.programs(), seed, absl::GetFlag(FLAGS_verify_iterations));
+    std::cout << "verify: " << comparison.cases << " cases, "
+              << comparison.mismatches << " mismatches" << std::endl;
+    const bool verified = comparison.mismatches == 0;
+    if (!verified || absl::GetFlag(FLAGS_verify)) {
+        return verified ? 0 : 1;
+    }
+
+    std::mt19937_64 rng(seed);
+    std::uniform_int_distribution<int> digit(1, 9);
+    std::vector<std::array<int, 14>> candidates(
+        absl::GetFlag(FLAGS_candidates));
+    for (std::array<int, 14>& c : candidates) {
+        for (int& d : c) {
+            d = digit(rng);
+        }
+    }
+    std::optional<int64_t> reference_checksum;
+    for (const aoc2022::AluEngine& engine : aoc2022::AluEngines()) {
+        const int64_t checksum =
+            aoc2022::BenchmarkEngine(engine, parser, candidates);
+        if (!reference_checksum.has_value()) {
+            reference_checksum = checksum;
+        } else if (checksum != *reference_checksum) {
+            std::cerr << engine.name << " checksum mismatch" << std::endl;
+            return 1;
+        }
+    }
+    aoc2022::BenchmarkLargestModelNumber(parser, seed,
+                                         absl::GetFlag(FLAGS_largest_prefixes));
+    return 0;
+}
@@ -0,0 +1,154 @@
+#include "alu_engine.h"
+
+#include <array>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "instruction.h"
+#include "parser.h"
+#include "types.h"
+
+namespace aoc2022 {
+
+namespace {
+
+// Straight from the puzzle statement, with the registers in an array instead
+// of the hand unrolled switches of TryInput.
+bool RunReference(const SingleProgram& program, int64_t& x, int64_t& y,
+                  int64_t& z, int64_t& w) {
+    std::array<int64_t*, 4> regs = {&x, &y, &z, &w};
+    for (const Instruction& instruction : program.instructions()) {
+        int64_t& a = *regs[static_cast<int>(instruction.lhs())];
+        const int64_t b = instruction.IsRhsInt()
+                              ? instruction.RhsInt()
+                              : *regs[static_cast<int>(instruction.RhsVars())];
+        switch (instruction.op_type()) {
+            case Op::kAdd:
+                a = a + b;
+                break;
+            case Op::kMul:
+                a = a * b;
+                break;
+            case Op::kDiv:
+                if (b == 0) {
+                    return false;
+                }
+                a = a / b;
+                break;
+            case Op::kMod:
+                if (a < 0 || b <= 0) {
+                    return false;
+                }
+                a = a % b;
+                break;
+            case Op::kEq:
+                a = a == b ? 1 : 0;
+                break;
+        }
+    }
+    return true;
+}
+
+bool RunInterpreter(const SingleProgram& program, int64_t& x, int64_t& y,
+                    int64_t& z, int64_t& w) {
+    return program.TryInput(x, y, z, w);
+}
+
+constexpr AluEngine kEngines[] = {
+    {"reference", &RunReference},
+    {"interpreter", &RunInterpreter},
+};
+
+struct Registers {
+    int64_t x = 0;
+    int64_t y = 0;
+    int64_t z = 0;
+    int64_t w = 0;
+    bool ok = true;
+
+    bool operator==(const Registers& o) const {
+        return x == o.x && y == o.y && z == o.z && w == o.w && ok == o.ok;
+    }
+
+    std::string DebugString() const {
+        return absl::StrFormat("x=%d y=%d z=%d w=%d ok=%v", x, y, z, w, ok);
+    }
+};
+
+Registers Run(const AluEngine& engine, const SingleProgram& program,
+              Registers regs) {
+    regs.ok = engine.run(program, regs.x, regs.y, regs.z, regs.w);
+    return regs;
+}
+
+}  // namespace
+
+absl::Span<const AluEngine> AluEngines() { return kEngines; }
+
+SingleProgram RandomProgram(std::mt19937_64& rng) {
+    constexpr absl::string_view kOps[] = {"add", "mul", "div", "mod", "eql"};
+    constexpr absl::string_view kVars[] = {"x", "y", "z", "w"};
+    std::uniform_int_distribution<int> length(1, 8);
+    std::uniform_int_distribution<int> pick_op(0, 4);
+    std::uniform_int_distribution<int> pick_var(0, 3);
+    std::uniform_int_distribution<int> constant(-3, 30);
+    std::bernoulli_distribution rhs_is_var(0.4);
+
+    std::vector<std::string> lines(length(rng));
+    for (std::string& line : lines) {
+        const absl::string_view op = kOps[pick_op(rng)];
+        const std::string rhs = op != "mul" && rhs_is_var(rng)
+                                    ? std::string(kVars[pick_var(rng)])
+                                    : absl::StrCat(constant(rng));
+        line = absl::StrCat(op, " ", kVars[pick_var(rng)], " ", rhs);
+    }
+    const std::vector<absl::string_view> views(lines.begin(), lines.end());
+    return SingleProgram(views);
+}
+
+EngineComparison CompareEngines(absl::Span<const SingleProgram> programs,
+                                uint64_t seed, int64_t iterations) {
+    const absl::Span<const AluEngine> engines = AluEngines();
+    std::mt19937_64 rng(seed);
+    std::uniform_int_distribution<int64_t> value(-1000, 1000);
+    std::uniform_int_distribution<int64_t> digit(1, 9);
+    std::uniform_int_distribution<size_t> stage(
+        0, programs.empty() ? 0 : programs.size() - 1);
+
+    EngineComparison result;
+    for (int64_t i = 0; i < iterations; ++i) {
+        const SingleProgram random_program = RandomProgram(rng);
+        const SingleProgram& program = i % 2 == 1 && !programs.empty()
+                                           ? programs[stage(rng)]
+                                           : random_program;
+        const Registers input = {value(rng), value(rng), value(rng),
+                                 digit(rng)};
+        const Registers expected = Run(engines[0], program, input);
+        ++result.cases;
+        result.failures += !expected.ok;
+        for (const AluEngine& engine : engines.subspan(1)) {
+            const Registers actual = Run(engine, program, input);
+            if (actual == expected) {
+                continue;
+            }
+            if (++result.mismatches <= 10) {
+                std::cerr << engine.name << " disagrees with "
+                          << engines[0].name << " on\n"
+                          << program.DebugPrint() << "  input    "
+                          << input.DebugString() << "\n  expected "
+                          << expected.DebugString() << "\n  actual   "
+                          << actual.DebugString() << std::endl;
+            }
+        }
+    }
+    return result;
+}
+
+}  // namespace aoc2022
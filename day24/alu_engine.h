@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <random>
+
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "parser.h"
+
+namespace aoc2022 {
+
+// An AluEngine executes a single stage program. It has the same contract as
+// SingleProgram::TryInput: registers are updated in place and false is
+// returned as soon as a div or mod would fail, leaving the registers as they
+// were at that point.
+struct AluEngine {
+    absl::string_view name;
+    bool (*run)(const SingleProgram& program, int64_t& x, int64_t& y,
+                int64_t& z, int64_t& w);
+};
+
+// Every engine known to the benchmark and verification harness. The first
+// entry is a deliberately simple reference implementation that all other
+// engines are checked against; new engines are added to the end.
+absl::Span<const AluEngine> AluEngines();
+
+// A short random program for differential checks of the engines. It hits
+// every op, including the div/mod failure paths. Multiplication only takes
+// small constants so the registers can't overflow.
+SingleProgram RandomProgram(std::mt19937_64& rng);
+
+struct EngineComparison {
+    int64_t cases = 0;
+    // Cases on which the reference engine hit a div or mod failure.
+    int64_t failures = 0;
+    // Engine runs that disagreed with the reference engine.
+    int64_t mismatches = 0;
+};
+
+// Runs every engine on `iterations` seeded random cases and compares the
+// registers and failure results with the reference engine's, printing the
+// first few mismatches to stderr. Every other case runs one of `programs`
+// rather than a random program, if there are any.
+EngineComparison CompareEngines(absl::Span<const SingleProgram> programs,
+                                uint64_t seed, int64_t iterations);
+
+}  // namespace aoc2022
@@ -0,0 +1,31 @@
+#include <cstdint>
+#include <iostream>
+
+#include "alu_engine.h"
+
+namespace aoc2022 {
+
+namespace {
+
+constexpr uint64_t kSeed = 2021;
+constexpr int64_t kCases = 200'000;
+
+}  // namespace
+
+}  // namespace aoc2022
+
+// Runs every ALU engine on seeded random programs and registers and checks
+// that the registers and the failure result match the reference engine's.
+int main() {
+    const aoc2022::EngineComparison comparison =
+        aoc2022::CompareEngines({}, aoc2022::kSeed, aoc2022::kCases);
+    std::cout << comparison.cases << " cases, " << comparison.failures
+              << " ALU failures, " << comparison.mismatches << " mismatches"
+              << std::endl;
+    // The failure paths must have been exercised too.
+    if (comparison.failures == 0 || comparison.failures == comparison.cases) {
+        std::cerr << "Random programs don't cover both outcomes" << std::endl;
+        return 1;
+    }
+    return comparison.mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,213 @@
+#include "checkpoint.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "absl/log/check.h"
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "file_io.h"
+
+namespace aoc2022 {
+
+namespace {
+
+constexpr absl::string_view kMagic = "AOC24CKP";
+constexpr uint32_t kVersion = 1;
+
+// FNV-1a, enough to catch truncated or garbled files.
+uint64_t Checksum(absl::string_view data) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (const char c : data) {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+template <typename T>
+void Append(std::string& out, const T value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+bool Consume(absl::string_view& in, T& value) {
+    if (in.size() < sizeof(T)) {
+        return false;
+    }
+    std::memcpy(&value, in.data(), sizeof(T));
+    in.remove_prefix(sizeof(T));
+    return true;
+}
+
+// Makes the rename of a file in the directory of `path` durable.
+void SyncParentDirectory(const std::string& path) {
+    const size_t slash = path.rfind('/');
+    const std::string dir = slash == std::string::npos
+                                ? std::string(".")
+                                : path.substr(0, std::max<size_t>(slash, 1));
+    const int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+}
+
+}  // namespace
+
+SearchCheckpoint::SearchCheckpoint(std::string path, int64_t first_chunk,
+                                   int64_t last_chunk, absl::Duration interval)
+    : path_(std::move(path)),
+      first_chunk_(first_chunk),
+      last_chunk_(last_chunk),
+      interval_(interval) {
+    CHECK_LE(first_chunk_, last_chunk_);
+    done_bits_.resize((last_chunk_ - first_chunk_ + 1 + 63) / 64);
+}
+
+bool SearchCheckpoint::IsDone(int64_t chunk) const {
+    assert(chunk >= first_chunk_ && chunk <= last_chunk_);
+    const int64_t bit = chunk - first_chunk_;
+    absl::MutexLock l(&mu_);
+    return (done_bits_[bit / 64] >> (bit % 64)) & 1;
+}
+
+void SearchCheckpoint::MarkDone(int64_t chunk, int64_t candidate) {
+    assert(chunk >= first_chunk_ && chunk <= last_chunk_);
+    const int64_t bit = chunk - first_chunk_;
+    bool save = false;
+    {
+        absl::MutexLock l(&mu_);
+        uint64_t& word = done_bits_[bit / 64];
+        if (!((word >> (bit % 64)) & 1)) {
+            word |= uint64_t{1} << (bit % 64);
+            ++num_done_;
+        }
+        if (candidate > 0 && candidate < best_) {
+            best_ = candidate;
+        }
+        // Claim the save here so that only one caller makes it.
+        if (absl::Now() - last_save_ >= interval_) {
+            last_save_ = absl::Now();
+            save = true;
+        }
+    }
+    if (save && !Save()) {
+        std::cerr << "Failed to write checkpoint " << path_ << std::endl;
+    }
+}
+
+int64_t SearchCheckpoint::best() const {
+    absl::MutexLock l(&mu_);
+    return best_;
+}
+
+int64_t SearchCheckpoint::num_done() const {
+    absl::MutexLock l(&mu_);
+    return num_done_;
+}
+
+bool SearchCheckpoint::Save() {
+    // Holding write_mu_ while taking the snapshot keeps snapshots and writes
+    // in the same order, so an older state never replaces a newer one.
+    absl::MutexLock write_lock(&write_mu_);
+    std::string data;
+    {
+        absl::MutexLock l(&mu_);
+        // Reset the timer even on failure so a broken disk doesn't turn
+        // every MarkDone into a write attempt.
+        last_save_ = absl::Now();
+        data = SerializeLocked();
+    }
+
+    const std::string tmp_path = absl::StrCat(path_, ".tmp");
+    const int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    const bool ok = common::WriteAll(fd, data) && fsync(fd) == 0;
+    close(fd);
+    if (!ok || rename(tmp_path.c_str(), path_.c_str()) != 0) {
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    SyncParentDirectory(path_);
+    return true;
+}
+
+std::string SearchCheckpoint::SerializeLocked() const {
+    std::string data(kMagic);
+    Append(data, kVersion);
+    Append(data, first_chunk_);
+    Append(data, last_chunk_);
+    Append(data, best_);
+    Append(data, num_done_);
+    for (const uint64_t word : done_bits_) {
+        Append(data, word);
+    }
+    Append(data, Checksum(data));
+    return data;
+}
+
+bool SearchCheckpoint::Load() {
+    std::ifstream input(path_, std::ios::binary);
+    if (!input.is_open()) {
+        return false;
+    }
+    std::stringstream buffer;
+    buffer << input.rdbuf();
+    const std::string contents = buffer.str();
+
+    absl::string_view in = contents;
+    if (in.size() < kMagic.size() + sizeof(uint64_t) ||
+        !absl::StartsWith(in, kMagic)) {
+        return false;
+    }
+    const absl::string_view payload =
+        in.substr(0, in.size() - sizeof(uint64_t));
+    uint64_t checksum;
+    std::memcpy(&checksum, in.data() + payload.size(), sizeof(checksum));
+    if (checksum != Checksum(payload)) {
+        return false;
+    }
+
+    in = payload.substr(kMagic.size());
+    uint32_t version;
+    int64_t first_chunk, last_chunk, best, num_done;
+    if (!Consume(in, version) || version != kVersion ||
+        !Consume(in, first_chunk) || first_chunk != first_chunk_ ||
+        !Consume(in, last_chunk) || last_chunk != last_chunk_ ||
+        !Consume(in, best) || !Consume(in, num_done)) {
+        return false;
+    }
+    std::vector<uint64_t> done_bits(done_bits_.size());
+    for (uint64_t& word : done_bits) {
+        if (!Consume(in, word)) {
+            return false;
+        }
+    }
+    if (!in.empty()) {
+        return false;
+    }
+
+    absl::MutexLock l(&mu_);
+    best_ = best;
+    num_done_ = num_done;
+    done_bits_ = std::move(done_bits);
+    return true;
+}
+
+}  // namespace aoc2022
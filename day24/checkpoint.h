@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+
+namespace aoc2022 {
+
+// SearchCheckpoint tracks the progress of a long running search: which chunks
+// (integer ids in [first_chunk, last_chunk]) have completed and the best
+// candidate seen so far. The state is periodically written to `path` so that
+// a preempted run can be resumed without redoing completed chunks.
+//
+// The on-disk format is a small binary file: a header, the best candidate, a
+// bitmap with one bit per chunk and a trailing checksum. Writes go to a
+// temporary file that is fsync'ed and then renamed over `path`, so a crash
+// never leaves a torn checkpoint behind.
+//
+// Thread-safe.
+class SearchCheckpoint {
+   public:
+    static constexpr int64_t kNoCandidate = std::numeric_limits<int64_t>::max();
+
+    SearchCheckpoint(std::string path, int64_t first_chunk,
+                     int64_t last_chunk, absl::Duration interval);
+
+    SearchCheckpoint(const SearchCheckpoint&) = delete;
+    SearchCheckpoint& operator=(const SearchCheckpoint&) = delete;
+
+    // Replaces the in-memory state with the contents of `path`. Returns false
+    // if the file is missing, corrupt or was written for a different chunk
+    // range, in which case the in-memory state is left untouched.
+    bool Load();
+
+    // Writes the current state to `path`. Returns false on I/O failure.
+    bool Save() ABSL_LOCKS_EXCLUDED(write_mu_, mu_);
+
+    bool IsDone(int64_t chunk) const;
+
+    // Records `chunk` as complete. `candidate` is the result of the chunk, or
+    // a non-positive value if the chunk produced nothing. The best (smallest
+    // positive) candidate is kept. Saves if `interval` has elapsed since the
+    // last save.
+    void MarkDone(int64_t chunk, int64_t candidate);
+
+    // Smallest positive candidate seen so far, or kNoCandidate.
+    int64_t best() const;
+    int64_t num_done() const;
+
+   private:
+    std::string SerializeLocked() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+    const std::string path_;
+    const int64_t first_chunk_;
+    const int64_t last_chunk_;
+    const absl::Duration interval_;
+
+    // Serializes writes to `path`. Taken before mu_, which is only held to
+    // snapshot the state, so IsDone and MarkDone don't wait for the disk.
+    absl::Mutex write_mu_ ABSL_ACQUIRED_BEFORE(mu_);
+    mutable absl::Mutex mu_;
+    int64_t best_ ABSL_GUARDED_BY(mu_) = kNoCandidate;
+    int64_t num_done_ ABSL_GUARDED_BY(mu_) = 0;
+    std::vector<uint64_t> done_bits_ ABSL_GUARDED_BY(mu_);
+    absl::Time last_save_ ABSL_GUARDED_BY(mu_) = absl::Now();
+};
+
+}  // namespace aoc2022
@@ -0,0 +1,279 @@
+#include "coordinator.h"
+
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+#include "absl/log/check.h"
+#include "absl/strings/string_view.h"
+#include "file_io.h"
+
+namespace aoc2022 {
+
+namespace {
+
+// Sent from the coordinator to a worker. Inclusive range of prefixes.
+struct ShardRequest {
+    int64_t begin;
+    int64_t end;
+};
+
+// Sent from a worker to the coordinator once per finished prefix. Both
+// messages are far below PIPE_BUF, so writes are atomic and reads never see
+// half a message.
+struct PrefixResult {
+    int64_t prefix;
+    int64_t candidate;
+};
+
+bool ReadExact(int fd, void* buf, size_t size) {
+    char* out = static_cast<char*>(buf);
+    while (size > 0) {
+        const ssize_t n = read(fd, out, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        out += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool WriteExact(int fd, const void* buf, size_t size) {
+    return common::WriteAll(
+        fd, absl::string_view(static_cast<const char*>(buf), size));
+}
+
+// Body of a forked worker. Never returns: the worker must not run the
+// destructors of objects it shares with the coordinator (e.g. the thread
+// pool, whose threads don't exist in the child).
+[[noreturn]] void WorkerMain(Parser& parser, int task_fd, int result_fd) {
+    ShardRequest request;
+    while (ReadExact(task_fd, &request, sizeof(request))) {
+        for (int64_t prefix = request.begin; prefix <= request.end; ++prefix) {
+            const PrefixResult result = {prefix, parser.SearchPrefix(prefix)};
+            if (!WriteExact(result_fd, &result, sizeof(result))) {
+                _exit(1);
+            }
+        }
+    }
+    _exit(0);
+}
+
+}  // namespace
+
+Coordinator::Coordinator(Parser& parser, int num_workers,
+                         int64_t prefixes_per_shard,
+                         SearchCheckpoint* checkpoint)
+    : parser_(parser),
+      num_workers_(num_workers),
+      prefixes_per_shard_(prefixes_per_shard),
+      checkpoint_(checkpoint),
+      winner_(std::numeric_limits<int64_t>::max()) {
+    CHECK_GT(num_workers_, 0);
+    CHECK_GT(prefixes_per_shard_, 0);
+}
+
+int64_t Coordinator::Run() {
+    winner_ = checkpoint_ != nullptr ? checkpoint_->best()
+                                     : std::numeric_limits<int64_t>::max();
+
+    // Group consecutive prefixes that still need work into shards.
+    for (int64_t prefix = kFirstPrefix; prefix <= kLastPrefix; ++prefix) {
+        if (checkpoint_ != nullptr && checkpoint_->IsDone(prefix)) {
+            continue;
+        }
+        if (pending_.empty() || pending_.back().end != prefix - 1 ||
+            pending_.back().end - pending_.back().begin + 1 >=
+                prefixes_per_shard_) {
+            pending_.push_back({prefix, prefix});
+        } else {
+            pending_.back().end = prefix;
+        }
+    }
+
+    // A dead worker must surface as EOF/EPIPE, not kill the coordinator.
+    struct sigaction ignore = {};
+    struct sigaction previous;
+    ignore.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &ignore, &previous);
+
+    workers_.resize(std::min<size_t>(num_workers_, pending_.size()));
+    for (Worker& worker : workers_) {
+        Spawn(worker);
+        Assign(worker);
+    }
+
+    std::vector<pollfd> fds;
+    std::vector<Worker*> polled;
+    while (true) {
+        fds.clear();
+        polled.clear();
+        for (Worker& worker : workers_) {
+            if (worker.shard.has_value()) {
+                fds.push_back({worker.result_fd, POLLIN, 0});
+                polled.push_back(&worker);
+            }
+        }
+        if (fds.empty()) {
+            break;
+        }
+        if (poll(fds.data(), fds.size(), -1) < 0) {
+            CHECK_EQ(errno, EINTR);
+            continue;
+        }
+        for (size_t i = 0; i < fds.size(); ++i) {
+            if (fds[i].revents == 0) {
+                continue;
+            }
+            Worker& worker = *polled[i];
+            if (!Drain(worker)) {
+                HandleExit(worker);
+            }
+        }
+        // Finished and respawned workers pick up the next shard.
+        for (Worker& worker : workers_) {
+            if (!worker.shard.has_value() && worker.pid > 0) {
+                Assign(worker);
+            }
+        }
+    }
+
+    // Closing the task pipes tells the workers to exit.
+    for (Worker& worker : workers_) {
+        if (worker.pid <= 0) {
+            continue;
+        }
+        close(worker.task_fd);
+        int status;
+        waitpid(worker.pid, &status, 0);
+        close(worker.result_fd);
+        worker = Worker();
+    }
+    sigaction(SIGPIPE, &previous, nullptr);
+
+    if (checkpoint_ != nullptr && !checkpoint_->Save()) {
+        std::cerr << "Failed to write final checkpoint" << std::endl;
+    }
+    return winner_;
+}
+
+void Coordinator::Spawn(Worker& worker) {
+    int task_pipe[2];
+    int result_pipe[2];
+    CHECK_EQ(pipe(task_pipe), 0);
+    CHECK_EQ(pipe(result_pipe), 0);
+    // Don't let buffered output get duplicated into the child.
+    std::cout.flush();
+    std::cerr.flush();
+
+    const pid_t pid = fork();
+    CHECK_GE(pid, 0);
+    if (pid == 0) {
+        // Drop every pipe end inherited from the coordinator, otherwise other
+        // workers would never see EOF on their task pipes.
+        for (const Worker& other : workers_) {
+            if (other.pid > 0) {
+                close(other.task_fd);
+                close(other.result_fd);
+            }
+        }
+        close(task_pipe[1]);
+        close(result_pipe[0]);
+        WorkerMain(parser_, task_pipe[0], result_pipe[1]);
+    }
+    close(task_pipe[0]);
+    close(result_pipe[1]);
+    worker.pid = pid;
+    worker.task_fd = task_pipe[1];
+    worker.result_fd = result_pipe[0];
+}
+
+void Coordinator::Assign(Worker& worker) {
+    if (pending_.empty()) {
+        return;
+    }
+    const Shard shard = pending_.front();
+    pending_.pop_front();
+    const ShardRequest request = {shard.begin, shard.end};
+    worker.shard = shard;
+    // If the worker is already gone its result pipe reports EOF and
+    // HandleExit requeues the shard.
+    WriteExact(worker.task_fd, &request, sizeof(request));
+}
+
+bool Coordinator::Drain(Worker& worker) {
+    PrefixResult results[256];
+    ssize_t n;
+    do {
+        n = read(worker.result_fd, results, sizeof(results));
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) {
+        return false;
+    }
+    for (size_t i = 0; i < n / sizeof(PrefixResult); ++i) {
+        Record(results[i].prefix, results[i].candidate);
+        worker.shard->begin = results[i].prefix + 1;
+        // Attempts count crashes at the shard's current first prefix.
+        worker.shard->attempts = 0;
+    }
+    if (worker.shard->begin > worker.shard->end) {
+        worker.shard.reset();
+    }
+    return true;
+}
+
+void Coordinator::HandleExit(Worker& worker) {
+    int status = 0;
+    waitpid(worker.pid, &status, 0);
+    close(worker.task_fd);
+    close(worker.result_fd);
+    std::cerr << "Worker " << worker.pid << " died";
+    if (WIFSIGNALED(status)) {
+        std::cerr << " with signal " << WTERMSIG(status);
+    } else if (WIFEXITED(status)) {
+        std::cerr << " with exit code " << WEXITSTATUS(status);
+    }
+    std::cerr << std::endl;
+
+    if (worker.shard.has_value()) {
+        Shard remaining = *worker.shard;
+        if (++remaining.attempts >= kMaxShardAttempts) {
+            std::cerr << "Skipping prefix " << remaining.begin << " after "
+                      << remaining.attempts << " crashed attempts"
+                      << std::endl;
+            skipped_prefixes_.push_back(remaining.begin);
+            ++remaining.begin;
+            remaining.attempts = 0;
+        }
+        if (remaining.begin <= remaining.end) {
+            pending_.push_front(remaining);
+        }
+    }
+    worker = Worker();
+    if (!pending_.empty()) {
+        Spawn(worker);
+    }
+}
+
+void Coordinator::Record(int64_t prefix, int64_t candidate) {
+    if (candidate > 0 && candidate < winner_) {
+        winner_ = candidate;
+    }
+    if (checkpoint_ != nullptr) {
+        checkpoint_->MarkDone(prefix, candidate);
+    }
+}
+
+}  // namespace aoc2022
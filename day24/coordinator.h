@@ -0,0 +1,84 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <vector>
+
+#include "checkpoint.h"
+#include "parser.h"
+
+namespace aoc2022 {
+
+// Coordinator runs the prefix search of `Parser::ParallelFinder` in forked
+// worker processes instead of threads.
+//
+// The prefix range is cut into shards of consecutive prefixes. Each worker
+// owns a pair of pipes: the coordinator writes shard assignments to one and
+// the worker streams back one result per finished prefix on the other. If a
+// worker dies, the unfinished part of its shard is handed to a replacement
+// worker. A prefix that kills kMaxShardAttempts workers in a row is skipped
+// so a single bad digit range can't stall the run.
+//
+// Workers are forked from the calling process after parsing, so they share
+// the parsed programs copy-on-write. Linux/POSIX only.
+class Coordinator {
+   public:
+    static constexpr int kMaxShardAttempts = 3;
+
+    // `checkpoint` may be null. If set, prefixes it already marks as done are
+    // not searched and every reported prefix is recorded in it.
+    Coordinator(Parser& parser, int num_workers, int64_t prefixes_per_shard,
+                SearchCheckpoint* checkpoint);
+
+    Coordinator(const Coordinator&) = delete;
+    Coordinator& operator=(const Coordinator&) = delete;
+
+    // Searches [kFirstPrefix, kLastPrefix] and returns the smallest positive
+    // candidate, or int64 max if none was found.
+    int64_t Run();
+
+    // Prefixes that were given up on because they crashed their workers.
+    const std::vector<int64_t>& skipped_prefixes() const {
+        return skipped_prefixes_;
+    }
+
+   private:
+    // Inclusive range of prefixes.
+    struct Shard {
+        int64_t begin;
+        int64_t end;
+        // Workers that died in a row on prefix `begin`.
+        int attempts = 0;
+    };
+
+    struct Worker {
+        pid_t pid = -1;
+        int task_fd = -1;
+        int result_fd = -1;
+        std::optional<Shard> shard;
+    };
+
+    void Spawn(Worker& worker);
+    // Hands the next pending shard to `worker`, if any.
+    void Assign(Worker& worker);
+    // Reads the available results of `worker`. Returns false once the
+    // worker's result pipe is closed.
+    bool Drain(Worker& worker);
+    void HandleExit(Worker& worker);
+    void Record(int64_t prefix, int64_t candidate);
+
+    Parser& parser_;
+    const int num_workers_;
+    const int64_t prefixes_per_shard_;
+    SearchCheckpoint* const checkpoint_;
+
+    std::deque<Shard> pending_;
+    std::vector<Worker> workers_;
+    std::vector<int64_t> skipped_prefixes_;
+    int64_t winner_;
+};
+
+}  // namespace aoc2022
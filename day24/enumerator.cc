@@ -0,0 +1,303 @@
+#include "enumerator.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/log/check.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
+#include "executor.h"
+#include "file_io.h"
+#include "instruction.h"
+#include "thread_pool.h"
+#include "trace.h"
+#include "types.h"
+
+namespace aoc2022 {
+
+namespace {
+
+// Every 14 digit number fits in 47 bits.
+constexpr int kMaxDigits = 14;
+constexpr int kBinaryBytes = 6;
+
+// Whether `program` writes each of x, y and z before reading it, so that the
+// value going into the stage can't matter. `mul v 0` writes v without reading
+// it; w is always the input. A register the program never touches is passed
+// through to later stages, so it isn't overwritten.
+std::array<bool, 3> Overwritten(const SingleProgram& program) {
+    std::array<bool, 4> seen = {false, false, false, true};
+    std::array<bool, 3> overwritten = {};
+    for (const Instruction& instruction : program.instructions()) {
+        if (instruction.IsRhsVars()) {
+            seen[static_cast<int>(instruction.RhsVars())] = true;
+        }
+        const int lhs = static_cast<int>(instruction.lhs());
+        if (!seen[lhs]) {
+            seen[lhs] = true;
+            overwritten[lhs] = instruction.op_type() == Op::kMul &&
+                               instruction.IsRhsInt() &&
+                               instruction.RhsInt() == 0;
+        }
+    }
+    return overwritten;
+}
+
+}  // namespace
+
+bool AbslParseFlag(absl::string_view text, ModelNumberFormat* format,
+                   std::string* error) {
+    if (text == "text") {
+        *format = ModelNumberFormat::kText;
+    } else if (text == "binary") {
+        *format = ModelNumberFormat::kBinary;
+    } else {
+        *error = "expected one of text, binary";
+        return false;
+    }
+    return true;
+}
+
+std::string AbslUnparseFlag(ModelNumberFormat format) {
+    switch (format) {
+        case ModelNumberFormat::kText:
+            return "text";
+        case ModelNumberFormat::kBinary:
+            return "binary";
+    }
+    return "text";
+}
+
+FileSink::FileSink(int fd, ModelNumberFormat format, int digits)
+    : fd_(fd), format_(format), digits_(digits) {
+    CHECK_LE(digits, kMaxDigits);
+}
+
+void FileSink::Consume(absl::Span<const int64_t> numbers) {
+    std::string out;
+    if (format_ == ModelNumberFormat::kText) {
+        out.resize(numbers.size() * (digits_ + 1));
+        char* p = out.data();
+        for (int64_t number : numbers) {
+            // No digit is 0, so every number is exactly digits_ long.
+            for (int i = digits_ - 1; i >= 0; --i) {
+                p[i] = '0' + number % 10;
+                number /= 10;
+            }
+            p[digits_] = '\n';
+            p += digits_ + 1;
+        }
+    } else {
+        out.resize(numbers.size() * kBinaryBytes);
+        char* p = out.data();
+        for (const int64_t number : numbers) {
+            for (int i = 0; i < kBinaryBytes; ++i) {
+                p[i] = static_cast<char>(number >> (8 * i));
+            }
+            p += kBinaryBytes;
+        }
+    }
+
+    absl::MutexLock lock(&mu_);
+    if (ok() && !common::WriteAll(fd_, out)) {
+        failed_.store(true, std::memory_order_relaxed);
+    }
+}
+
+struct ModelNumberEnumerator::Worker {
+    explicit Worker(int num_digits) : dead(num_digits), counts(num_digits) {}
+
+    // Per stage, states from which no digits reach z = 0.
+    std::vector<absl::flat_hash_set<State>> dead;
+    // Per stage, the number of ways to reach z = 0 from a state.
+    std::vector<absl::flat_hash_map<State, int64_t>> counts;
+    // Numbers not yet handed to the sink.
+    std::vector<int64_t> batch;
+    int64_t found = 0;
+};
+
+ModelNumberEnumerator::ModelNumberEnumerator(const Parser& parser)
+    : programs_(parser.programs()) {
+    CHECK_LE(num_digits(), kMaxDigits);
+    overwritten_.reserve(programs_.size());
+    for (const SingleProgram& program : programs_) {
+        overwritten_.push_back(Overwritten(program));
+    }
+    split_digits_ = std::min(3, num_digits());
+}
+
+ModelNumberEnumerator::~ModelNumberEnumerator() = default;
+
+ModelNumberEnumerator::State ModelNumberEnumerator::Key(
+    int stage, const State& state) const {
+    const std::array<bool, 3>& overwritten = overwritten_[stage];
+    return State{
+        .x = overwritten[0] ? 0 : state.x,
+        .y = overwritten[1] ? 0 : state.y,
+        .z = overwritten[2] ? 0 : state.z,
+    };
+}
+
+bool ModelNumberEnumerator::Run(int stage, int digit, State& state) const {
+    int64_t w = digit;
+    return programs_[stage].TryInput(state.x, state.y, state.z, w);
+}
+
+int64_t ModelNumberEnumerator::NumPrefixes() const {
+    int64_t num_prefixes = 1;
+    for (int i = 0; i < split_digits_; ++i) {
+        num_prefixes *= 9;
+    }
+    return num_prefixes;
+}
+
+int64_t ModelNumberEnumerator::RunPrefix(int64_t index, State& state) const {
+    std::array<int, 3> digits;
+    for (int i = split_digits_ - 1; i >= 0; --i) {
+        digits[i] = index % 9 + 1;
+        index /= 9;
+    }
+    int64_t number = 0;
+    for (int i = 0; i < split_digits_; ++i) {
+        if (!Run(i, digits[i], state)) {
+            return -1;
+        }
+        number = number * 10 + digits[i];
+    }
+    return number;
+}
+
+bool ModelNumberEnumerator::Search(Worker& worker, int stage,
+                                   const State& state, int64_t number,
+                                   ModelNumberSink& sink) const {
+    if (stage == num_digits()) {
+        if (state.z != 0) {
+            return false;
+        }
+        worker.batch.push_back(number);
+        ++worker.found;
+        if (worker.batch.size() == kBatchSize) {
+            sink.Consume(worker.batch);
+            worker.batch.clear();
+        }
+        return true;
+    }
+
+    const State key = Key(stage, state);
+    absl::flat_hash_set<State>& dead = worker.dead[stage];
+    if (dead.contains(key)) {
+        return false;
+    }
+    bool any = false;
+    for (int digit = 1; digit <= 9; ++digit) {
+        State next = key;
+        if (Run(stage, digit, next)) {
+            any |= Search(worker, stage + 1, next, number * 10 + digit, sink);
+        }
+    }
+    if (!any) {
+        dead.insert(key);
+    }
+    return any;
+}
+
+int64_t ModelNumberEnumerator::CountFrom(Worker& worker, int stage,
+                                         const State& state) const {
+    if (stage == num_digits()) {
+        return state.z == 0 ? 1 : 0;
+    }
+
+    const State key = Key(stage, state);
+    absl::flat_hash_map<State, int64_t>& counts = worker.counts[stage];
+    if (auto it = counts.find(key); it != counts.end()) {
+        return it->second;
+    }
+    int64_t total = 0;
+    for (int digit = 1; digit <= 9; ++digit) {
+        State next = key;
+        if (Run(stage, digit, next)) {
+            total += CountFrom(worker, stage + 1, next);
+        }
+    }
+    // Not through `it`: the recursion may have rehashed the table.
+    counts.emplace(key, total);
+    return total;
+}
+
+std::unique_ptr<ModelNumberEnumerator::Worker>
+ModelNumberEnumerator::Acquire() {
+    {
+        absl::MutexLock lock(&mu_);
+        if (!idle_.empty()) {
+            std::unique_ptr<Worker> worker = std::move(idle_.back());
+            idle_.pop_back();
+            return worker;
+        }
+    }
+    return std::make_unique<Worker>(num_digits());
+}
+
+void ModelNumberEnumerator::Release(std::unique_ptr<Worker> worker) {
+    absl::MutexLock lock(&mu_);
+    idle_.push_back(std::move(worker));
+}
+
+int64_t ModelNumberEnumerator::Enumerate(ModelNumberSink& sink) {
+    common::DefaultExecutor().ParallelFor(
+        common::IndexRange{0, NumPrefixes()}, /*grain=*/1,
+        [this, &sink](int64_t i) {
+            common::TraceSpan span("EnumeratePrefix", "prefix", i);
+            State state;
+            const int64_t prefix = RunPrefix(i, state);
+            if (prefix < 0) {
+                return;
+            }
+            std::unique_ptr<Worker> worker = Acquire();
+            Search(*worker, split_digits_, state, prefix, sink);
+            Release(std::move(worker));
+        });
+
+    // Every worker is idle again; flush their last batches.
+    absl::MutexLock lock(&mu_);
+    int64_t found = 0;
+    for (const std::unique_ptr<Worker>& worker : idle_) {
+        if (!worker->batch.empty()) {
+            sink.Consume(worker->batch);
+        }
+        found += worker->found;
+    }
+    idle_.clear();
+    return found;
+}
+
+int64_t ModelNumberEnumerator::Count() {
+    const int64_t count = common::DefaultExecutor().ParallelReduce(
+        common::IndexRange{0, NumPrefixes()}, int64_t{0},
+        [this](int64_t i) -> int64_t {
+            common::TraceSpan span("CountPrefix", "prefix", i);
+            State state;
+            if (RunPrefix(i, state) < 0) {
+                return 0;
+            }
+            std::unique_ptr<Worker> worker = Acquire();
+            const int64_t count = CountFrom(*worker, split_digits_, state);
+            Release(std::move(worker));
+            return count;
+        },
+        std::plus<int64_t>(), /*grain=*/1);
+
+    absl::MutexLock lock(&mu_);
+    idle_.clear();
+    return count;
+}
+
+}  // namespace aoc2022
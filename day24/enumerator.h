@@ -0,0 +1,145 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
+#include "parser.h"
+
+namespace aoc2022 {
+
+// Receives the model numbers found by ModelNumberEnumerator, a batch at a
+// time. Consume is called from several worker threads at once, so
+// implementations synchronize per batch rather than per number.
+class ModelNumberSink {
+   public:
+    virtual ~ModelNumberSink() = default;
+
+    // Neither the batches nor the numbers within one arrive in any particular
+    // order.
+    virtual void Consume(absl::Span<const int64_t> numbers) = 0;
+};
+
+enum class ModelNumberFormat {
+    // Decimal, one number per line.
+    kText,
+    // 6-byte little-endian integers; 14 digits need 47 bits.
+    kBinary,
+};
+
+bool AbslParseFlag(absl::string_view text, ModelNumberFormat* format,
+                   std::string* error);
+std::string AbslUnparseFlag(ModelNumberFormat format);
+
+// Writes batches to a file descriptor. Each batch is encoded by the thread
+// that hands it over; only the write itself is serialized.
+class FileSink : public ModelNumberSink {
+   public:
+    // `digits` is the length of every number, i.e. the number of programs.
+    FileSink(int fd, ModelNumberFormat format, int digits);
+
+    void Consume(absl::Span<const int64_t> numbers) override;
+
+    // False once a write has failed; later batches are dropped.
+    bool ok() const { return !failed_.load(std::memory_order_relaxed); }
+
+   private:
+    const int fd_;
+    const ModelNumberFormat format_;
+    const int digits_;
+    absl::Mutex mu_;
+    std::atomic<bool> failed_ = false;
+};
+
+// Finds every model number the programs accept, i.e. every digit string
+// from 1-9 that leaves z = 0 without faulting the ALU.
+//
+// A depth-first search over the digits, split into one task per three digit
+// prefix on common::DefaultExecutor(). Whether a stage can still reach
+// z = 0 depends only on the registers going into it, so the search
+// remembers the (stage, x, y, z) states that turned out dead and never
+// searches them twice. Registers a stage writes before reading them are left
+// out of its states, so states differing only in leftovers from the previous
+// stage are shared; registers it doesn't touch are kept, since later stages
+// may read them. Each task borrows a worker, its memo and output batch, from
+// a free list, so memos carry over between tasks and the search itself takes
+// no locks. States reached from different prefixes rarely coincide, so a
+// shared memo would save little.
+class ModelNumberEnumerator {
+   public:
+    // Numbers are collected into batches of this many per worker.
+    static constexpr int kBatchSize = 1 << 16;
+
+    // `parser` must outlive the enumerator and have at most 14 programs.
+    explicit ModelNumberEnumerator(const Parser& parser);
+    ~ModelNumberEnumerator();
+
+    // Streams every accepted number into `sink` and returns how many there
+    // were.
+    int64_t Enumerate(ModelNumberSink& sink);
+
+    // Counts the accepted numbers without producing them. Memoizes the
+    // number of ways to finish from each state, so only distinct states are
+    // searched.
+    int64_t Count();
+
+   private:
+    struct State {
+        int64_t x = 0;
+        int64_t y = 0;
+        int64_t z = 0;
+
+        friend bool operator==(const State&, const State&) = default;
+        template <typename H>
+        friend H AbslHashValue(H h, const State& s) {
+            return H::combine(std::move(h), s.x, s.y, s.z);
+        }
+    };
+    struct Worker;
+
+    int num_digits() const { return programs_.size(); }
+
+    // `state` with the registers stage `stage` overwrites zeroed.
+    State Key(int stage, const State& state) const;
+
+    // Runs stage `stage` on `state` with input `digit`. Returns false if the
+    // ALU faults.
+    bool Run(int stage, int digit, State& state) const;
+
+    // Number of prefixes of split_digits_ digits.
+    int64_t NumPrefixes() const;
+
+    // Runs the first split_digits_ stages on the digits of the `index`th
+    // prefix, and returns the prefix as a number or -1 if it faults.
+    int64_t RunPrefix(int64_t index, State& state) const;
+
+    // Adds the accepted numbers that continue `number`, whose first `stage`
+    // digits left `state`, to the worker's batch. Returns whether there were
+    // any.
+    bool Search(Worker& worker, int stage, const State& state, int64_t number,
+                ModelNumberSink& sink) const;
+
+    // Returns the number of ways to finish from `state` before `stage`.
+    int64_t CountFrom(Worker& worker, int stage, const State& state) const;
+
+    // Hands out an idle worker, or a new one if there is none.
+    std::unique_ptr<Worker> Acquire();
+    void Release(std::unique_ptr<Worker> worker);
+
+    const std::vector<SingleProgram>& programs_;
+    // Per stage, whether it writes x, y and z before reading them.
+    std::vector<std::array<bool, 3>> overwritten_;
+    int split_digits_ = 0;
+    absl::Mutex mu_;
+    std::vector<std::unique_ptr<Worker>> idle_ ABSL_GUARDED_BY(mu_);
+};
+
+}  // namespace aoc2022
@@ -0,0 +1,135 @@
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
+#include "enumerator.h"
+#include "parser.h"
+
+namespace aoc2022 {
+
+namespace {
+
+struct TestCase {
+    absl::string_view name;
+    std::vector<absl::string_view> lines;
+    int64_t expected;
+};
+
+// Registers some stages don't touch must reach the later stages that read
+// them.
+const TestCase kCases[] = {
+    {
+        // Stage 3 sets y to its digit and stage 5 accepts iff its digit
+        // equals y, which stage 4 passes through untouched.
+        .name = "y through an untouched stage",
+        .lines = {"inp w", "mul w 1",                    //
+                  "inp w", "mul w 1",                    //
+                  "inp w", "mul w 1",                    //
+                  "inp w", "mul y 0", "add y w",         //
+                  "inp w", "add z 0",                    //
+                  "inp w", "eql y w", "eql y 0", "add z y"},
+        .expected = 59049,
+    },
+    {
+        // z = w0 - w3, carried through stages that only touch x and y.
+        .name = "z through untouched stages",
+        .lines = {"inp w", "add z w",                    //
+                  "inp w", "mul x 0", "add x w",         //
+                  "inp w", "mul y 0", "add y w",         //
+                  "inp w", "mul w -1", "add z w"},
+        .expected = 729,
+    },
+    {
+        // Stage 2 reads y, set by stage 0, without writing it, and leaves
+        // z = w0 - w2.
+        .name = "y read but not overwritten",
+        .lines = {"inp w", "add y w",                    //
+                  "inp w", "mul w 1",                    //
+                  "inp w", "mul x 0", "add x w", "mul x -1", "add x y",
+                  "add z x",                             //
+                  "inp w", "mul w 1"},
+        .expected = 729,
+    },
+};
+
+// Every accepted number in ascending order, by running the programs on every
+// digit string.
+std::vector<int64_t> BruteForce(const Parser& parser) {
+    const std::vector<SingleProgram>& programs = parser.programs();
+    int64_t num_inputs = 1;
+    for (size_t i = 0; i < programs.size(); ++i) {
+        num_inputs *= 9;
+    }
+    std::vector<int64_t> accepted;
+    for (int64_t index = 0; index < num_inputs; ++index) {
+        int64_t x = 0, y = 0, z = 0;
+        int64_t number = 0;
+        int64_t scale = num_inputs / 9;
+        bool ok = true;
+        for (size_t i = 0; ok && i < programs.size(); ++i, scale /= 9) {
+            int64_t w = index / scale % 9 + 1;
+            number = number * 10 + w;
+            ok = programs[i].TryInput(x, y, z, w);
+        }
+        if (ok && z == 0) {
+            accepted.push_back(number);
+        }
+    }
+    return accepted;
+}
+
+class CollectingSink : public ModelNumberSink {
+   public:
+    void Consume(absl::Span<const int64_t> numbers) override {
+        absl::MutexLock lock(&mu_);
+        numbers_.insert(numbers_.end(), numbers.begin(), numbers.end());
+    }
+
+    // Every number consumed, in ascending order.
+    std::vector<int64_t> Sorted() {
+        absl::MutexLock lock(&mu_);
+        std::sort(numbers_.begin(), numbers_.end());
+        return numbers_;
+    }
+
+   private:
+    absl::Mutex mu_;
+    std::vector<int64_t> numbers_ ABSL_GUARDED_BY(mu_);
+};
+
+}  // namespace
+
+}  // namespace aoc2022
+
+// Checks the enumerator's counts against hand-derived ones, and its counts
+// and numbers against brute force, on small programs.
+int main() {
+    int failures = 0;
+    for (const aoc2022::TestCase& test : aoc2022::kCases) {
+        const aoc2022::Parser parser(test.lines);
+        const std::vector<int64_t> accepted = aoc2022::BruteForce(parser);
+        const int64_t count = aoc2022::ModelNumberEnumerator(parser).Count();
+        aoc2022::CollectingSink sink;
+        const int64_t enumerated =
+            aoc2022::ModelNumberEnumerator(parser).Enumerate(sink);
+        const std::vector<int64_t> numbers = sink.Sorted();
+        const bool same_numbers = numbers == accepted;
+        std::cout << test.name << ": expected " << test.expected
+                  << ", brute force " << accepted.size() << ", Count "
+                  << count << ", Enumerate " << enumerated << " ("
+                  << numbers.size() << " consumed, "
+                  << (same_numbers ? "same" : "different")
+                  << " numbers)" << std::endl;
+        if (static_cast<int64_t>(accepted.size()) != test.expected ||
+            count != test.expected || enumerated != test.expected ||
+            !same_numbers) {
+            ++failures;
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
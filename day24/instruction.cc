@@ -2,7 +2,6 @@
 
 #include <iostream>
 #include <string>
-#include <vector>
 
 #include "absl/log/check.h"
 #include "absl/strings/numbers.h"
@@ -51,8 +50,13 @@ std::string Instruction::Print() const {
 }
 
 Instruction::Instruction(absl::string_view str) {
-    const std::vector<std::string> parts = absl::StrSplit(str, " ");
-    CHECK_EQ(parts.size(), 3);
+    absl::string_view parts[3];
+    int num_parts = 0;
+    for (absl::string_view part : absl::StrSplit(str, ' ')) {
+        CHECK_LT(num_parts, 3) << str;
+        parts[num_parts++] = part;
+    }
+    CHECK_EQ(num_parts, 3) << str;
     absl::string_view op_str = parts[0];
     absl::string_view lhs_str = parts[1];
     absl::string_view rhs_str = parts[2];
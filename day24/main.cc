@@ -1,31 +1,208 @@
-#include <cassert>
-#include <chrono>
-#include <filesystem>
-#include <fstream>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdint>
 #include <iostream>
+#include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
+#include "absl/base/call_once.h"
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
 #include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "checkpoint.h"
+#include "coordinator.h"
+#include "cpu_topology.h"
+#include "enumerator.h"
+#include "executor.h"
+#include "mapped_file.h"
 #include "parser.h"
+#include "runner.h"
+#include "thread_pool.h"
 
-// Program entry point.
-// Reads infile and parses the text.
-int main() {
-    std::ifstream input;
-    const std::string filepath = absl::StrCat(
-        std::filesystem::current_path().string(), "/", "infile.txt");
-    input.open(filepath);
-    assert(input.is_open());
-    std::vector<std::string> strings;
-    std::string line;
-    while (input) {
-        getline(input, line);
-        strings.push_back(line);
+ABSL_FLAG(std::string, checkpoint, "",
+          "If set, search progress is periodically written to this file.");
+ABSL_FLAG(bool, resume, false,
+          "Resume from --checkpoint, skipping prefixes it marks as done. Only "
+          "meaningful for a single run.");
+ABSL_FLAG(absl::Duration, checkpoint_interval, absl::Minutes(1),
+          "Minimum time between two checkpoint writes.");
+ABSL_FLAG(int, workers, 0,
+          "Number of forked worker processes for --engine=processes. 0 starts "
+          "one per available CPU.");
+ABSL_FLAG(int64_t, prefixes_per_shard, 64,
+          "Number of consecutive prefixes handed to a worker process at once.");
+ABSL_FLAG(int, threads, 0,
+          "Cap on search threads. 0 uses every CPU available to the process, "
+          "capped by its cgroup CPU quota.");
+ABSL_FLAG(common::Placement, placement, common::Placement::kNone,
+          "Pinning of search threads to CPUs: none, compact (fill one socket "
+          "first) or scatter (round-robin over sockets).");
+ABSL_FLAG(absl::Duration, pool_stats_interval, absl::ZeroDuration(),
+          "If positive, thread pool metrics are written to stderr this often "
+          "and once more at the end of each search. Ignored by the processes "
+          "engine.");
+ABSL_FLAG(std::string, output, "",
+          "For --engine=enumerate, file every accepted model number is "
+          "written to, or - for stdout. If empty they are only counted.");
+ABSL_FLAG(aoc2022::ModelNumberFormat, output_format,
+          aoc2022::ModelNumberFormat::kText,
+          "Format of --output: text (one number per line) or binary (6-byte "
+          "little-endian integers).");
+
+namespace {
+
+// Starts logging --pool_stats_interval, once. Only the in-process engines
+// call this: the processes engine forks, and no other thread may be holding
+// a lock when it does.
+void MaybeLogPoolStats() {
+    static absl::once_flag once;
+    absl::call_once(once, [] {
+        const absl::Duration interval =
+            absl::GetFlag(FLAGS_pool_stats_interval);
+        if (interval > absl::ZeroDuration()) {
+            common::DefaultExecutor().LogStatsEvery(interval);
+        }
+    });
+}
+
+// Parsed programs plus the checkpoint a search records its progress in.
+struct Search {
+    explicit Search(absl::Span<const absl::string_view> lines)
+        : parser(lines) {
+        if (absl::GetFlag(FLAGS_checkpoint).empty()) {
+            return;
+        }
+        checkpoint = std::make_unique<aoc2022::SearchCheckpoint>(
+            absl::GetFlag(FLAGS_checkpoint), aoc2022::kFirstPrefix,
+            aoc2022::kLastPrefix, absl::GetFlag(FLAGS_checkpoint_interval));
+        if (!absl::GetFlag(FLAGS_resume)) {
+            return;
+        }
+        if (checkpoint->Load()) {
+            std::cerr << "Resuming with " << checkpoint->num_done()
+                      << " prefixes done" << std::endl;
+        } else {
+            std::cerr << "No usable checkpoint, starting from scratch"
+                      << std::endl;
+        }
+    }
+
+    aoc2022::Parser parser;
+    std::unique_ptr<aoc2022::SearchCheckpoint> checkpoint;
+};
+
+// Searches on the in-process thread pool.
+common::SolveFn ParsePool(const common::MappedFile& input) {
+    MaybeLogPoolStats();
+    auto search = std::make_unique<Search>(input.Lines());
+    return [search = std::move(search)] {
+        const int64_t answer =
+            search->parser.ParallelFinder(search->checkpoint.get());
+        if (absl::GetFlag(FLAGS_pool_stats_interval) > absl::ZeroDuration()) {
+            std::cerr << common::DefaultExecutor().Stats().DebugString();
+        }
+        return absl::StrCat(answer);
+    };
+}
+
+// Searches in forked worker processes.
+common::SolveFn ParseProcesses(const common::MappedFile& input) {
+    auto search = std::make_unique<Search>(input.Lines());
+    return [search = std::move(search)] {
+        int workers = absl::GetFlag(FLAGS_workers);
+        if (workers <= 0) {
+            workers = common::DefaultThreadCount();
+        }
+        aoc2022::Coordinator coordinator(
+            search->parser, workers, absl::GetFlag(FLAGS_prefixes_per_shard),
+            search->checkpoint.get());
+        return absl::StrCat(coordinator.Run());
+    };
+}
+
+// Counts every accepted model number.
+common::SolveFn ParseCount(const common::MappedFile& input) {
+    MaybeLogPoolStats();
+    auto parser = std::make_unique<aoc2022::Parser>(input.Lines());
+    return [parser = std::move(parser)] {
+        aoc2022::ModelNumberEnumerator enumerator(*parser);
+        return absl::StrCat(enumerator.Count());
+    };
+}
+
+// Discards the numbers; Enumerate counts them anyway.
+class NullSink : public aoc2022::ModelNumberSink {
+   public:
+    void Consume(absl::Span<const int64_t> /*numbers*/) override {}
+};
+
+// Writes every accepted model number to --output.
+common::SolveFn ParseEnumerate(const common::MappedFile& input) {
+    MaybeLogPoolStats();
+    const std::string output = absl::GetFlag(FLAGS_output);
+    int fd = -1;
+    if (output == "-") {
+        if (absl::GetFlag(FLAGS_json)) {
+            std::cerr << "--output=- would mix the numbers into the --json "
+                         "report on stdout"
+                      << std::endl;
+            return nullptr;
+        }
+        fd = STDOUT_FILENO;
+    } else if (!output.empty()) {
+        fd = open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                  0644);
+        if (fd < 0) {
+            std::cerr << "Can't open " << output << std::endl;
+            return nullptr;
+        }
     }
-    input.close();
-    aoc2022::Parser parser(strings);
-    std::cout << parser.ParallelFinder() << std::endl;
+    auto parser = std::make_unique<aoc2022::Parser>(input.Lines());
+    return [parser = std::move(parser), fd] {
+        aoc2022::ModelNumberEnumerator enumerator(*parser);
+        int64_t count = 0;
+        if (fd < 0) {
+            NullSink sink;
+            count = enumerator.Enumerate(sink);
+        } else {
+            aoc2022::FileSink sink(fd, absl::GetFlag(FLAGS_output_format),
+                                   parser->programs().size());
+            count = enumerator.Enumerate(sink);
+            bool ok = sink.ok();
+            if (fd != STDOUT_FILENO) {
+                ok &= close(fd) == 0;
+            }
+            if (!ok) {
+                std::cerr << "Failed to write " << absl::GetFlag(FLAGS_output)
+                          << std::endl;
+                return std::string();
+            }
+        }
+        return absl::StrCat(count);
+    };
+}
+
+}  // namespace
+
+// Program entry point.
+// Solves --input (infile.txt by default) with the chosen engine.
+int main(int argc, char** argv) {
+    absl::ParseCommandLine(argc, argv);
 
-    return 0;
+    common::SetDefaultExecutorOptions(common::ThreadPool::Options{
+        .num_threads = absl::GetFlag(FLAGS_threads),
+        .placement = absl::GetFlag(FLAGS_placement),
+    });
+    std::vector<common::Engine> engines;
+    engines.push_back({.name = "pool", .parse = ParsePool});
+    engines.push_back({.name = "processes", .parse = ParseProcesses});
+    engines.push_back({.name = "count", .parse = ParseCount});
+    engines.push_back({.name = "enumerate", .parse = ParseEnumerate});
+    return common::RunSolver(std::move(engines));
 }
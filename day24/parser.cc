@@ -1,6 +1,9 @@
 #include "parser.h"
 
+#include <algorithm>
+#include <atomic>
 #include <iostream>
+#include <limits>
 #include <span>
 #include <string>
 #include <vector>
@@ -9,14 +12,19 @@
 #include "absl/log/check.h"
 #include "absl/strings/match.h"
 #include "absl/strings/str_cat.h"
-#include "absl/synchronization/blocking_counter.h"
 #include "absl/types/span.h"
+#include "executor.h"
+#include "profiler.h"
+#include "thread_pool.h"
+#include "trace.h"
 
 namespace aoc2022 {
 
-SingleProgram::SingleProgram(absl::Span<const std::string> strings) {
+SingleProgram::SingleProgram(absl::Span<const absl::string_view> strings,
+                             int stage)
+    : stage_(stage) {
     instructions_.reserve(strings.size());
-    for (const std::string& s : strings) {
+    for (absl::string_view s : strings) {
         instructions_.emplace_back(s);
     }
 }
@@ -54,8 +62,11 @@ bool SingleProgram::TryInput(int64_t& x, int64_t& y, int64_t& z,
     // w is provided by the input. x, y & z are defaulted to 0 in the beginning
     // before the start.
 
+    ALU_PROFILE_STAGE(stage_);
+
     // Process the instructions.
     for (const Instruction& instruction : instructions_) {
+        ALU_PROFILE_INSTRUCTION(stage_, &instruction - instructions_.data());
         int64_t rhs =
             instruction.IsRhsInt()
                 ? instruction.RhsInt()
@@ -97,6 +108,7 @@ bool SingleProgram::TryInput(int64_t& x, int64_t& y, int64_t& z,
             }
             case Op::kDiv: {
                 if (rhs == 0) {
+                    ALU_PROFILE_EXIT(stage_, profile::ExitReason::kDivByZero);
                     return false;
                 }
                 switch (instruction.lhs()) {
@@ -117,29 +129,39 @@ bool SingleProgram::TryInput(int64_t& x, int64_t& y, int64_t& z,
             }
             case Op::kMod: {
                 if (rhs <= 0) {
+                    ALU_PROFILE_EXIT(stage_,
+                                     profile::ExitReason::kModNonPositiveRhs);
                     return false;
                 }
                 switch (instruction.lhs()) {
                     case Vars::kX:
                         if (x < 0) {
+                            ALU_PROFILE_EXIT(
+                                stage_, profile::ExitReason::kModNegativeLhs);
                             return false;
                         }
                         x = x % rhs;
                         break;
                     case Vars::kY:
                         if (y < 0) {
+                            ALU_PROFILE_EXIT(
+                                stage_, profile::ExitReason::kModNegativeLhs);
                             return false;
                         }
                         y = y % rhs;
                         break;
                     case Vars::kZ:
                         if (z < 0) {
+                            ALU_PROFILE_EXIT(
+                                stage_, profile::ExitReason::kModNegativeLhs);
                             return false;
                         }
                         z = z % rhs;
                         break;
                     case Vars::kW:
                         if (w < 0) {
+                            ALU_PROFILE_EXIT(
+                                stage_, profile::ExitReason::kModNegativeLhs);
                             return false;
                         }
                         w = w % rhs;
@@ -207,32 +229,110 @@ absl::InlinedVector<int, 8> To8Array(int in) {
 
 }  // namespace
 
-int64_t Parser::ParallelFinder() {
-    int64_t winner = std::numeric_limits<int64_t>::max();
-    absl::Mutex winner_mu;
-    CHECK(thread_pool_->size() == 11);
-    absl::BlockingCounter counter(11);
-    for (int i = 0; i < 11; ++i) {
-        thread_pool_->Schedule([this, i, &counter, &winner, &winner_mu]() {
-            int start = 453'111 + i;
-            for (int loop = start; loop <= 459'999; loop = loop + 11) {
-                absl::InlinedVector<int, 6> start_seq = To6Array(loop);
-                if (start_seq.empty()) continue;
-                int64_t candidate = LargestModelNumber(start_seq);
-                if (candidate > 0) {
-                    {
-                        absl::MutexLock lck(&winner_mu);
-                        if (candidate < winner) {
-                            winner = candidate;
-                        }
-                    }
-                }
+int64_t Parser::SearchPrefix(int64_t prefix,
+                             const common::CancellationToken& cancel) {
+    absl::InlinedVector<int, 6> start_seq = To6Array(prefix);
+    if (start_seq.empty()) {
+        return -1;
+    }
+    return LargestModelNumber(start_seq, cancel);
+}
+
+namespace {
+
+// z acts as a stack of base 26 digits; the fewer a prefix leaves behind, the
+// fewer the remaining eight programs have to pop to reach z = 0.
+common::ThreadPool::Priority PrefixPriority(int64_t z) {
+    int depth = 0;
+    for (; z > 0 && depth < 3; z /= 26) {
+        ++depth;
+    }
+    if (depth <= 1) {
+        return common::ThreadPool::Priority::kHigh;
+    }
+    return depth == 2 ? common::ThreadPool::Priority::kNormal
+                      : common::ThreadPool::Priority::kLow;
+}
+
+}  // namespace
+
+int64_t Parser::ParallelFinder(SearchCheckpoint* checkpoint) {
+    constexpr int64_t kNone = std::numeric_limits<int64_t>::max();
+    std::atomic<int64_t> best(checkpoint != nullptr ? checkpoint->best()
+                                                    : kNone);
+    if (best.load() == kSmallestSuffix) {
+        return kSmallestSuffix;
+    }
+
+    struct Prefix {
+        int64_t prefix;
+        absl::InlinedVector<int, 6> starter;
+    };
+    std::vector<Prefix> by_priority[common::ThreadPool::kNumPriorities];
+    for (int64_t prefix = kFirstPrefix; prefix <= kLastPrefix; ++prefix) {
+        if (checkpoint != nullptr && checkpoint->IsDone(prefix)) {
+            continue;
+        }
+        absl::InlinedVector<int, 6> starter = To6Array(prefix);
+        int64_t x = 0;
+        int64_t y = 0;
+        int64_t z = 0;
+        if (starter.empty() || !RunPrefix(starter, x, y, z)) {
+            if (checkpoint != nullptr) {
+                checkpoint->MarkDone(prefix, -1);
             }
-            counter.DecrementCount();
-        });
+            continue;
+        }
+        by_priority[static_cast<int>(PrefixPriority(z))].push_back(
+            {prefix, std::move(starter)});
     }
-    counter.Wait();
-    return winner;
+
+    // Nothing can beat kSmallestSuffix, so finding it ends the search. Any
+    // other candidate can still be beaten by a prefix not yet scanned, so
+    // short of that the search only narrows through `best`.
+    common::CancellationToken done;
+    common::ThreadPool& pool = common::DefaultExecutor();
+    std::vector<common::Future<void>> searches;
+    // Most promising first, so they also get to start first.
+    for (int level = common::ThreadPool::kNumPriorities - 1; level >= 0;
+         --level) {
+        for (const Prefix& p : by_priority[level]) {
+            searches.push_back(pool.Submit(
+                [this, checkpoint, &best, &done, p]() {
+                    common::TraceSpan span("SearchPrefix", "prefix",
+                                           p.prefix);
+                    const int64_t candidate =
+                        LargestModelNumber(p.starter, done, &best);
+                    if (candidate <= 0 && done.IsCancelled()) {
+                        // Interrupted, the prefix isn't finished.
+                        return;
+                    }
+                    if (checkpoint != nullptr) {
+                        checkpoint->MarkDone(p.prefix, candidate);
+                    }
+                    if (candidate <= 0) {
+                        return;
+                    }
+                    int64_t current = best.load(std::memory_order_relaxed);
+                    while (candidate < current &&
+                           !best.compare_exchange_weak(
+                               current, candidate,
+                               std::memory_order_relaxed)) {
+                    }
+                    if (candidate == kSmallestSuffix) {
+                        done.Cancel();
+                    }
+                },
+                done, static_cast<common::ThreadPool::Priority>(level)));
+        }
+    }
+    for (const common::Future<void>& search : searches) {
+        search.Wait();
+    }
+    if (checkpoint != nullptr && !checkpoint->Save()) {
+        std::cerr << "Failed to write final checkpoint" << std::endl;
+    }
+    return best.load();
 }
 
 namespace {
@@ -267,23 +367,38 @@ inline int64_t Jump(const int64_t start) {
 
 }  // namespace
 
-int64_t Parser::LargestModelNumber(const absl::InlinedVector<int, 6>& starter) {
-    // Precompute the x, y and z that comes out of the first 3 digits.
-    int64_t xx = 0;
-    int64_t yy = 0;
-    int64_t zz = 0;
-
+bool Parser::RunPrefix(const absl::InlinedVector<int, 6>& starter,
+                       int64_t& x, int64_t& y, int64_t& z) const {
     for (int i = 0; i < 6; ++i) {
         const SingleProgram& sp = programs_[i];
         int64_t w = starter[5 - i];
-        if (!sp.TryInput(xx, yy, zz, w)) {
-            return -1;
+        if (!sp.TryInput(x, y, z, w)) {
+            return false;
         }
     }
+    return true;
+}
+
+int64_t Parser::LargestModelNumber(const absl::InlinedVector<int, 6>& starter,
+                                   const common::CancellationToken& cancel,
+                                   const std::atomic<int64_t>* bound) {
+    // Precompute the x, y and z that comes out of the first 6 digits.
+    int64_t xx = 0;
+    int64_t yy = 0;
+    int64_t zz = 0;
+    if (!RunPrefix(starter, xx, yy, zz)) {
+        return -1;
+    }
 
     constexpr int64_t start_3 = 99'999'999;
-    constexpr int64_t end_3 = 11'111'111;
+    constexpr int64_t end_3 = kSmallestSuffix;
     for (int64_t loop = end_3; loop <= start_3; ++loop) {
+        if (loop % 4096 == 0 &&
+            (cancel.IsCancelled() ||
+             (bound != nullptr &&
+              loop >= bound->load(std::memory_order_relaxed)))) {
+            return -1;
+        }
         absl::InlinedVector<int, 8> in_arr = To8Array(loop);
         if (in_arr.empty()) {
             loop = Jump(loop);
@@ -300,28 +415,26 @@ int64_t Parser::LargestModelNumber(const absl::InlinedVector<int, 6>& starter) {
             }
         }
         if (z == 0) {
-            std::cout << "Found z = 0 at " << DPrintVector(starter) << loop << std::endl;
+            std::cerr << "Found z = 0 at " << DPrintVector(starter) << loop << std::endl;
             return loop;
         }
     }
     return -1;
 }
 
-Parser::Parser(absl::Span<const std::string> strings) {
-    std::vector<std::string> current;
-    for (const std::string& line : strings) {
-        if (absl::StartsWith(line, "inp")) {
-            // Start of a new program.
-            if (!current.empty()) {
-                programs_.emplace_back(current);
-            }
-            current.clear();
+Parser::Parser(absl::Span<const absl::string_view> strings) {
+    // Each program is the run of lines after an "inp" line.
+    size_t begin = 0;
+    for (size_t i = 0; i <= strings.size(); ++i) {
+        if (i < strings.size() && !absl::StartsWith(strings[i], "inp")) {
             continue;
         }
-        current.push_back(line);
+        if (i > begin) {
+            programs_.emplace_back(strings.subspan(begin, i - begin),
+                                   programs_.size());
+        }
+        begin = i + 1;
     }
-    programs_.emplace_back(current);
-    thread_pool_ = std::make_unique<common::ThreadPool>(11);
 }
 
 std::string Parser::DebugPrint() const {
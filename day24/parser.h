@@ -1,5 +1,6 @@
 #pragma once
 
+#include <atomic>
 #include <span>
 #include <string>
 #include <vector>
@@ -7,38 +8,86 @@
 
 #include "absl/container/flat_hash_set.h"
 #include "absl/container/inlined_vector.h"
+#include "absl/strings/string_view.h"
 #include "absl/types/span.h"
+#include "cancellation.h"
+#include "checkpoint.h"
 #include "instruction.h"
-#include "thread_pool.h"
 
 namespace aoc2022 {
 
 // A program is made up of one or more instructions. The start of the program,
-// the "input" is left out.
+// the "input" is left out. `stage` is the position of the program in the
+// whole input and is only used to attribute profiling counters.
 class SingleProgram {
    public:
-    explicit SingleProgram(absl::Span<const std::string> strings);
+    explicit SingleProgram(absl::Span<const absl::string_view> strings,
+                           int stage = 0);
     std::string DebugPrint() const;
 
     bool TryInput(int64_t& x, int64_t& y, int64_t& z, int64_t& w) const;
 
+    const std::vector<Instruction>& instructions() const {
+        return instructions_;
+    }
+
    private:
     std::vector<Instruction> instructions_;
+    int stage_;
 };
 
-// Parser takes in the input file as a list of strings and generates
-// a list of programs.
+// ParallelFinder searches the six digit prefixes in [kFirstPrefix,
+// kLastPrefix]. Each prefix is one chunk of work for checkpointing.
+inline constexpr int64_t kFirstPrefix = 453'111;
+inline constexpr int64_t kLastPrefix = 459'999;
+
+// LargestModelNumber scans eight digit suffixes upwards from this one, so no
+// candidate can be smaller.
+inline constexpr int64_t kSmallestSuffix = 11'111'111;
+
+// Parser takes in the input file as a list of lines and generates
+// a list of programs. The lines need only outlive the constructor.
 class Parser {
    public:
-    explicit Parser(absl::Span<const std::string> strings);
+    explicit Parser(absl::Span<const absl::string_view> strings);
 
     std::string DebugPrint() const;
 
-    int64_t ParallelFinder();
-    int64_t LargestModelNumber(const absl::InlinedVector<int, 6>& starter);
+    const std::vector<SingleProgram>& programs() const { return programs_; }
+
+    // Searches every prefix best-first: prefixes that leave z small, i.e.
+    // that look most likely to reach z = 0, are scheduled at a higher
+    // priority. The smallest candidate found so far bounds every other scan:
+    // a scan stops within 4096 candidates of reaching it. That bound is what
+    // cuts the search short in practice. Cancelling the remaining prefixes
+    // outright is only decisive once some prefix yields kSmallestSuffix,
+    // which real inputs don't; every prefix still runs its scan up to the
+    // bound.
+    //
+    // If `checkpoint` is non-null, prefixes it already marks as done are
+    // skipped and every finished prefix is recorded in it.
+    int64_t ParallelFinder(SearchCheckpoint* checkpoint = nullptr);
+
+    // Gives up and returns -1 soon after `cancel` is cancelled, or once the
+    // scan reaches `*bound` (if non-null) since it can no longer beat it.
+    int64_t LargestModelNumber(
+        const absl::InlinedVector<int, 6>& starter,
+        const common::CancellationToken& cancel =
+            common::CancellationToken::Never(),
+        const std::atomic<int64_t>* bound = nullptr);
+
+    // Runs LargestModelNumber for a single six digit prefix. Returns -1 for
+    // prefixes containing a zero digit or without a match.
+    int64_t SearchPrefix(int64_t prefix,
+                         const common::CancellationToken& cancel =
+                             common::CancellationToken::Never());
 
    private:
-    std::unique_ptr<common::ThreadPool> thread_pool_ = nullptr;
+    // Runs the first six programs on the digits of `starter`, which are
+    // stored least significant first. Returns false if the ALU faults.
+    bool RunPrefix(const absl::InlinedVector<int, 6>& starter, int64_t& x,
+                   int64_t& y, int64_t& z) const;
+
     std::vector<SingleProgram> programs_;
 };
 
@@ -0,0 +1,199 @@
+#include "profiler.h"
+
+#ifdef AOC_PROFILE
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/synchronization/mutex.h"
+
+namespace aoc2022::profile {
+
+namespace {
+
+// Only the owning thread writes a counter, so a relaxed load + store is
+// enough and avoids a locked read-modify-write on the hot path. Readers may
+// see slightly stale values while the search is still running.
+void Bump(std::atomic<uint64_t>& counter, uint64_t amount) {
+    counter.store(counter.load(std::memory_order_relaxed) + amount,
+                  std::memory_order_relaxed);
+}
+
+struct ThreadCounters {
+    std::array<std::array<std::atomic<uint64_t>, kMaxInstructions>,
+               kMaxStages>
+        instructions = {};
+    std::array<std::array<std::atomic<uint64_t>, kNumExitReasons>, kMaxStages>
+        exits = {};
+    std::array<std::atomic<uint64_t>, kMaxStages> cycles = {};
+    std::array<std::atomic<uint64_t>, kMaxStages> calls = {};
+};
+
+absl::string_view ExitReasonName(int reason) {
+    switch (static_cast<ExitReason>(reason)) {
+        case ExitReason::kDivByZero:
+            return "div by zero";
+        case ExitReason::kModNonPositiveRhs:
+            return "mod rhs <= 0";
+        case ExitReason::kModNegativeLhs:
+            return "mod lhs < 0";
+    }
+    return "unknown";
+}
+
+void PrintReportAtExit() { std::cerr << Report(); }
+
+// Owns the counters of every thread that ever ran TryInput. Counters outlive
+// their threads so that work done by pool threads that already exited still
+// shows up in the report.
+class Registry {
+   public:
+    Registry() { std::atexit(&PrintReportAtExit); }
+
+    ThreadCounters* Register() {
+        absl::MutexLock l(&mu_);
+        counters_.push_back(std::make_unique<ThreadCounters>());
+        return counters_.back().get();
+    }
+
+    template <typename Fn>
+    void ForEach(Fn fn) {
+        absl::MutexLock l(&mu_);
+        for (const std::unique_ptr<ThreadCounters>& c : counters_) {
+            fn(*c);
+        }
+    }
+
+   private:
+    absl::Mutex mu_;
+    std::vector<std::unique_ptr<ThreadCounters>> counters_
+        ABSL_GUARDED_BY(mu_);
+};
+
+Registry& GetRegistry() {
+    static Registry* registry = new Registry();
+    return *registry;
+}
+
+ThreadCounters& Local() {
+    thread_local ThreadCounters* counters = GetRegistry().Register();
+    return *counters;
+}
+
+}  // namespace
+
+void CountInstruction(int stage, int64_t index) {
+    if (stage < kMaxStages && index < kMaxInstructions) {
+        Bump(Local().instructions[stage][index], 1);
+    }
+}
+
+void CountExit(int stage, ExitReason reason) {
+    if (stage < kMaxStages) {
+        Bump(Local().exits[stage][static_cast<int>(reason)], 1);
+    }
+}
+
+void AddStageCycles(int stage, uint64_t cycles) {
+    if (stage < kMaxStages) {
+        ThreadCounters& local = Local();
+        Bump(local.cycles[stage], cycles);
+        Bump(local.calls[stage], 1);
+    }
+}
+
+uint64_t ReadCycleCounter() {
+#if defined(__x86_64__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t value;
+    asm volatile("mrs %0, cntvct_el0" : "=r"(value));
+    return value;
+#else
+    return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+std::string Report() {
+    ThreadCounters merged;
+    GetRegistry().ForEach([&merged](const ThreadCounters& c) {
+        for (int s = 0; s < kMaxStages; ++s) {
+            for (int i = 0; i < kMaxInstructions; ++i) {
+                Bump(merged.instructions[s][i], c.instructions[s][i]);
+            }
+            for (int r = 0; r < kNumExitReasons; ++r) {
+                Bump(merged.exits[s][r], c.exits[s][r]);
+            }
+            Bump(merged.cycles[s], c.cycles[s]);
+            Bump(merged.calls[s], c.calls[s]);
+        }
+    });
+
+    struct Hot {
+        int stage;
+        int index;
+        uint64_t count;
+    };
+    std::vector<Hot> hot;
+    uint64_t total = 0;
+    for (int s = 0; s < kMaxStages; ++s) {
+        for (int i = 0; i < kMaxInstructions; ++i) {
+            const uint64_t count = merged.instructions[s][i];
+            if (count > 0) {
+                hot.push_back({s, i, count});
+                total += count;
+            }
+        }
+    }
+    std::sort(hot.begin(), hot.end(), [](const Hot& a, const Hot& b) {
+        return a.count > b.count;
+    });
+
+    std::string ret = "=== ALU profile: hot instructions ===\n";
+    absl::StrAppendFormat(&ret, "%6s %6s %16s %7s\n", "stage", "instr",
+                          "executions", "share");
+    for (const Hot& h : hot) {
+        absl::StrAppendFormat(&ret, "%6d %6d %16d %6.2f%%\n", h.stage, h.index,
+                              h.count, 100.0 * h.count / total);
+    }
+
+    absl::StrAppend(&ret, "=== ALU profile: stages ===\n");
+    absl::StrAppendFormat(&ret, "%6s %14s %16s %12s", "stage", "calls",
+                          "cycles", "cycles/call");
+    for (int r = 0; r < kNumExitReasons; ++r) {
+        absl::StrAppendFormat(&ret, " %14s", ExitReasonName(r));
+    }
+    absl::StrAppend(&ret, "\n");
+    for (int s = 0; s < kMaxStages; ++s) {
+        const uint64_t calls = merged.calls[s];
+        if (calls == 0) {
+            continue;
+        }
+        const uint64_t cycles = merged.cycles[s];
+        absl::StrAppendFormat(&ret, "%6d %14d %16d %12.1f", s, calls, cycles,
+                              static_cast<double>(cycles) / calls);
+        for (int r = 0; r < kNumExitReasons; ++r) {
+            absl::StrAppendFormat(&ret, " %14d", merged.exits[s][r].load());
+        }
+        absl::StrAppend(&ret, "\n");
+    }
+    return ret;
+}
+
+}  // namespace aoc2022::profile
+
+#endif  // AOC_PROFILE
@@ -0,0 +1,77 @@
+#pragma once
+
+// Opt-in execution profiling for the ALU interpreter.
+//
+// Build with `bazel build --define aoc_profile=1 :main` to enable. Counters
+// are kept per thread and merged when the process exits, at which point a
+// report sorted by the hottest instructions is written to stderr. In the
+// normal build every ALU_PROFILE_* macro expands to nothing.
+
+#include <cstdint>
+
+#ifdef AOC_PROFILE
+#include <string>
+#endif
+
+namespace aoc2022::profile {
+
+// Why SingleProgram::TryInput bailed out early.
+enum class ExitReason {
+    kDivByZero = 0,
+    kModNonPositiveRhs = 1,
+    kModNegativeLhs = 2,
+};
+
+#ifdef AOC_PROFILE
+
+inline constexpr int kMaxStages = 16;
+inline constexpr int kMaxInstructions = 64;
+inline constexpr int kNumExitReasons = 3;
+
+void CountInstruction(int stage, int64_t index);
+void CountExit(int stage, ExitReason reason);
+void AddStageCycles(int stage, uint64_t cycles);
+
+// Raw cycle counter: rdtsc on x86-64, the virtual counter on aarch64.
+uint64_t ReadCycleCounter();
+
+// Merges the counters of every thread seen so far into a report.
+std::string Report();
+
+// Attributes the cycles spent in its scope to `stage`.
+class StageTimer {
+   public:
+    explicit StageTimer(int stage)
+        : stage_(stage), start_(ReadCycleCounter()) {}
+    ~StageTimer() { AddStageCycles(stage_, ReadCycleCounter() - start_); }
+
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+
+   private:
+    const int stage_;
+    const uint64_t start_;
+};
+
+#define ALU_PROFILE_INSTRUCTION(stage, index) \
+    ::aoc2022::profile::CountInstruction((stage), (index))
+#define ALU_PROFILE_EXIT(stage, reason) \
+    ::aoc2022::profile::CountExit((stage), (reason))
+#define ALU_PROFILE_STAGE(stage) \
+    ::aoc2022::profile::StageTimer alu_profile_stage_timer(stage)
+
+#else
+
+#define ALU_PROFILE_INSTRUCTION(stage, index) \
+    do {                                      \
+    } while (0)
+#define ALU_PROFILE_EXIT(stage, reason) \
+    do {                                \
+    } while (0)
+#define ALU_PROFILE_STAGE(stage) \
+    do {                         \
+    } while (0)
+
+#endif  // AOC_PROFILE
+
+}  // namespace aoc2022::profile
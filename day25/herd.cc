@@ -0,0 +1,364 @@
+#include "herd.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/log/check.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "executor.h"
+#include "thread_pool.h"
+
+namespace aoc2022 {
+
+namespace {
+
+#if defined(__x86_64__) && defined(__linux__)
+// Builds a baseline and an AVX2 version of a function; the dynamic loader
+// binds calls to the best one the CPU supports.
+#define HERD_KERNEL __attribute__((target_clones("avx2", "default")))
+#else
+#define HERD_KERNEL
+#endif
+
+// Words of each herd stepped by one task. Two herds of this size fit in a
+// typical L2 cache.
+constexpr int kWordsPerBand = 1 << 14;
+
+// Bits of the last word of a row that hold cells.
+uint64_t LastWordMask(int cols) {
+    return cols % 64 == 0 ? ~uint64_t{0} : (uint64_t{1} << (cols % 64)) - 1;
+}
+
+// Moves the east facing cucumbers of one row one cell right, wrapping from
+// the last column to the first. `movers` is one row of scratch space and ends
+// up holding the cucumbers that moved. Returns non-zero if any did.
+HERD_KERNEL uint64_t MoveEast(uint64_t* east, const uint64_t* south,
+                              uint64_t* movers, int words, int cols) {
+    const int last = words - 1;
+    const int last_bit = (cols - 1) % 64;
+    // Bit c: the cell right of column c is occupied.
+    for (int w = 0; w < last; ++w) {
+        movers[w] = ((east[w] | south[w]) >> 1) |
+                    ((east[w + 1] | south[w + 1]) << 63);
+    }
+    movers[last] = ((east[last] | south[last]) >> 1) |
+                   (((east[0] | south[0]) & 1) << last_bit);
+    uint64_t any = 0;
+    for (int w = 0; w < words; ++w) {
+        movers[w] = east[w] & ~movers[w];
+        any |= movers[w];
+    }
+    if (any == 0) {
+        return 0;
+    }
+    const uint64_t wrapped = (movers[last] >> last_bit) & 1;
+    east[0] = (east[0] & ~movers[0]) | (movers[0] << 1) | wrapped;
+    for (int w = 1; w < words; ++w) {
+        east[w] = (east[w] & ~movers[w]) | (movers[w] << 1) |
+                  (movers[w - 1] >> 63);
+    }
+    east[last] &= LastWordMask(cols);
+    return any;
+}
+
+// Moves the south facing cucumbers of one row into the row below, whose
+// cells as they were before the south phase are `below_east` and
+// `below_south`. `arriving` are the cucumbers that left the row above; the
+// ones leaving this row are written to `leaving`. Returns non-zero if any
+// left.
+HERD_KERNEL uint64_t MoveSouth(uint64_t* south, const uint64_t* below_east,
+                               const uint64_t* below_south,
+                               const uint64_t* arriving, uint64_t* leaving,
+                               int words) {
+    uint64_t any = 0;
+    for (int w = 0; w < words; ++w) {
+        const uint64_t movers = south[w] & ~(below_east[w] | below_south[w]);
+        leaving[w] = movers;
+        south[w] = (south[w] & ~movers) | arriving[w];
+        any |= movers;
+    }
+    return any;
+}
+
+}  // namespace
+
+Herd::Herd(absl::Span<const absl::string_view> lines) {
+    while (!lines.empty() && lines.back().empty()) {
+        lines.remove_suffix(1);
+    }
+    CHECK(!lines.empty());
+    Init(lines.size(), lines[0].size());
+    CHECK(Allocate(""));
+    for (int r = 0; r < rows_; ++r) {
+        ParseRow(r, lines[r]);
+    }
+}
+
+std::unique_ptr<Herd> Herd::Parse(absl::string_view text,
+                                  const Options& options) {
+    CHECK(!text.empty()) << "empty grid";
+
+    // Every row is followed by a newline, except possibly the last.
+    size_t end = text.size();
+    while (end > 0 && text[end - 1] == '\n') {
+        --end;
+    }
+    const size_t cols = std::min(text.find('\n'), end);
+    const size_t stride = cols + 1;
+    const size_t rows = (end + 1) / stride;
+    CHECK_EQ(rows * stride, end + 1)
+        << "rows are not all " << cols << " wide";
+    CHECK_LE(rows, static_cast<size_t>(std::numeric_limits<int>::max()));
+
+    std::unique_ptr<Herd> herd(new Herd());
+    herd->Init(rows, cols);
+    if (!herd->Allocate(options.working_file)) {
+        return nullptr;
+    }
+    herd->ForEachBand([&herd, text, stride, cols](Band& band, const Band&) {
+        for (int r = band.begin; r < band.end; ++r) {
+            const size_t offset = r * stride;
+            CHECK(offset + cols == text.size() || text[offset + cols] == '\n')
+                << "row " << r << " is not " << cols << " wide";
+            herd->ParseRow(r, text.substr(offset, cols));
+        }
+    });
+    return herd;
+}
+
+Herd::~Herd() {
+    if (mapping_ != nullptr) {
+        munmap(mapping_, mapping_size_);
+    }
+}
+
+void Herd::Init(int rows, int cols) {
+    CHECK_GT(rows, 0);
+    CHECK_GT(cols, 0);
+    rows_ = rows;
+    cols_ = cols;
+    words_per_row_ = (cols_ + 63) / 64;
+    zeros_.assign(words_per_row_, 0);
+    moves_.assign(rows_, 0);
+    changed_.assign(rows_, 0);
+    active_.assign(rows_, 1);
+    const int rows_per_band = std::max(1, kWordsPerBand / words_per_row_);
+    for (int begin = 0; begin < rows_; begin += rows_per_band) {
+        Band& band = bands_.emplace_back();
+        band.begin = begin;
+        band.end = std::min(rows_, begin + rows_per_band);
+        band.movers.resize(words_per_row_);
+        band.leaving.resize(words_per_row_);
+        band.halo.resize(words_per_row_);
+    }
+}
+
+bool Herd::Allocate(const std::string& working_file) {
+    const size_t words = static_cast<size_t>(rows_) * words_per_row_;
+    if (working_file.empty()) {
+        storage_.assign(2 * words, 0);
+        east_ = storage_.data();
+        south_ = east_ + words;
+        return true;
+    }
+    const int fd = open(working_file.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    // A fresh file reads as zeros and takes no disk space until written.
+    const size_t bytes = 2 * words * sizeof(uint64_t);
+    if (ftruncate(fd, bytes) != 0) {
+        close(fd);
+        return false;
+    }
+    void* mapping =
+        mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+    mapping_ = mapping;
+    mapping_size_ = bytes;
+    east_ = static_cast<uint64_t*>(mapping);
+    south_ = east_ + words;
+    return true;
+}
+
+void Herd::ParseRow(int row, absl::string_view line) {
+    CHECK_EQ(static_cast<int>(line.size()), cols_) << "ragged row " << row;
+    uint64_t* east = EastRow(row);
+    uint64_t* south = SouthRow(row);
+    bool bad = false;
+    for (int w = 0; w < words_per_row_; ++w) {
+        const char* cells = line.data() + 64 * w;
+        const int n = std::min(64, cols_ - 64 * w);
+        uint64_t e = 0;
+        uint64_t s = 0;
+        for (int b = 0; b < n; ++b) {
+            e |= uint64_t{cells[b] == '>'} << b;
+            s |= uint64_t{cells[b] == 'v'} << b;
+            bad |= cells[b] != '>' && cells[b] != 'v' && cells[b] != '.';
+        }
+        east[w] = e;
+        south[w] = s;
+    }
+    CHECK(!bad) << "unexpected character in row " << row;
+}
+
+void Herd::Prefetch(const Band& band) const {
+    int first = band.begin;
+    while (first < band.end && !active_[first]) {
+        ++first;
+    }
+    if (first == band.end) {
+        return;
+    }
+    int last = band.end - 1;
+    while (!active_[last]) {
+        --last;
+    }
+    // The south phase also reads the row below.
+    const size_t begin_word = static_cast<size_t>(first) * words_per_row_;
+    const size_t end_word =
+        std::min<size_t>(last + 2, rows_) * words_per_row_;
+    static const uintptr_t kPageMask = sysconf(_SC_PAGESIZE) - 1;
+    for (const uint64_t* herd : {east_, south_}) {
+        const uintptr_t begin =
+            reinterpret_cast<uintptr_t>(herd + begin_word) & ~kPageMask;
+        const uintptr_t end = reinterpret_cast<uintptr_t>(herd + end_word);
+        madvise(reinterpret_cast<void*>(begin), end - begin, MADV_WILLNEED);
+    }
+}
+
+template <typename Fn>
+void Herd::ForEachBand(Fn fn) {
+    const int num_bands = bands_.size();
+    if (num_bands == 1) {
+        fn(bands_[0], bands_[0]);
+        return;
+    }
+    common::DefaultExecutor().ParallelFor(
+        common::IndexRange{0, num_bands}, /*grain=*/1,
+        [this, &fn, num_bands](int64_t i) {
+            fn(bands_[i], bands_[(i + 1) % num_bands]);
+        });
+}
+
+void Herd::StepEast(Band& band) {
+    if (mapping_ != nullptr) {
+        Prefetch(band);
+    }
+    // Only the band above reads the halo, and only if its last row is active.
+    if (active_[band.begin == 0 ? rows_ - 1 : band.begin - 1]) {
+        std::copy_n(SouthRow(band.begin), words_per_row_, band.halo.begin());
+    }
+    for (int r = band.begin; r < band.end; ++r) {
+        if (active_[r] && MoveEast(EastRow(r), SouthRow(r),
+                                   band.movers.data(), words_per_row_,
+                                   cols_)) {
+            moves_[r] |= kMovedEast;
+        }
+    }
+}
+
+void Herd::StepSouth(Band& band, const Band& next) {
+    const uint64_t* arriving = zeros_.data();
+    uint64_t* leaving = band.leaving.data();
+    uint64_t* spare = band.movers.data();
+    for (int r = band.begin; r < band.end; ++r) {
+        if (!active_[r]) {
+            // Nothing can leave a row that can't change.
+            arriving = zeros_.data();
+            continue;
+        }
+        const bool last = r + 1 == band.end;
+        const int below = last ? next.begin : r + 1;
+        if (MoveSouth(SouthRow(r), EastRow(below),
+                      last ? next.halo.data() : SouthRow(below), arriving,
+                      leaving, words_per_row_)) {
+            moves_[r] |= kMovedSouth;
+            arriving = leaving;
+            std::swap(leaving, spare);
+        } else {
+            arriving = zeros_.data();
+        }
+    }
+    band.outflow = arriving == zeros_.data() ? nullptr : arriving;
+}
+
+bool Herd::UpdateActive() {
+    // A row changed if a cucumber left it or arrived from the row above.
+    bool any = false;
+    uint8_t above = moves_[rows_ - 1];
+    for (int r = 0; r < rows_; ++r) {
+        const uint8_t own = moves_[r];
+        changed_[r] = own != 0 || (above & kMovedSouth) != 0;
+        any |= changed_[r];
+        above = own;
+    }
+    std::fill(moves_.begin(), moves_.end(), 0);
+    // A row's next state depends only on itself and its two neighbours.
+    for (int r = 0; r < rows_; ++r) {
+        active_[r] = changed_[r == 0 ? rows_ - 1 : r - 1] | changed_[r] |
+                     changed_[r + 1 == rows_ ? 0 : r + 1];
+    }
+    return any;
+}
+
+bool Herd::Step() {
+    ForEachBand([this](Band& band, const Band&) { StepEast(band); });
+    ForEachBand(
+        [this](Band& band, const Band& next) { StepSouth(band, next); });
+    for (int b = 0; b < static_cast<int>(bands_.size()); ++b) {
+        const Band& band = bands_[b];
+        if (band.outflow == nullptr) {
+            continue;
+        }
+        uint64_t* first = SouthRow(bands_[(b + 1) % bands_.size()].begin);
+        for (int w = 0; w < words_per_row_; ++w) {
+            first[w] |= band.outflow[w];
+        }
+    }
+    return UpdateActive();
+}
+
+int64_t Herd::StepsUntilStill() {
+    int64_t steps = 1;
+    while (Step()) {
+        ++steps;
+    }
+    return steps;
+}
+
+std::string Herd::DebugPrint() const {
+    std::string ret;
+    ret.reserve(static_cast<size_t>(rows_) * (cols_ + 1));
+    for (int r = 0; r < rows_; ++r) {
+        const size_t row = static_cast<size_t>(r) * words_per_row_;
+        for (int c = 0; c < cols_; ++c) {
+            const uint64_t bit = uint64_t{1} << (c % 64);
+            if (east_[row + c / 64] & bit) {
+                ret.push_back('>');
+            } else if (south_[row + c / 64] & bit) {
+                ret.push_back('v');
+            } else {
+                ret.push_back('.');
+            }
+        }
+        ret.push_back('\n');
+    }
+    return ret;
+}
+
+}  // namespace aoc2022
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+
+namespace aoc2022 {
+
+// The two sea cucumber herds on a grid that wraps around both edges. Each step
+// the east facing herd ('>') moves one cell right wherever that cell is free,
+// then the south facing herd ('v') moves one cell down likewise.
+//
+// Each herd is a row-major bitset, `words_per_row_` 64-bit words per row with
+// the bits past `cols_` kept clear. A step is a handful of shifts and masks per
+// word: east moves are a one-bit funnel shift along the row, south moves an
+// AND-NOT against the next row. The row kernels are compiled for AVX2 as well
+// and picked at load time on CPUs that support it.
+//
+// Large grids are cut into bands of rows that step in parallel on
+// common::DefaultExecutor(). East moves stay within a row; for south moves
+// each band snapshots its first row during the east phase so the band above
+// can read it as a halo, and the cucumbers leaving a band's last row are
+// merged into the next band once all bands are done.
+//
+// A row can only change if it or a neighbouring row changed in the previous
+// step, so each step skips the rows outside that set. Once most of the grid
+// has settled, a step costs little more than the rows still moving.
+//
+// The herds can also live in a shared mapping of a working file rather than
+// in memory. The kernel then pages bands in as they are stepped and writes
+// them back when memory runs short, so grids larger than RAM can be run. Each
+// band's active rows are read ahead before it steps; a settled band is only
+// touched for the first row, when the row above it is active.
+class Herd {
+   public:
+    struct Options {
+        // If set, the herds are kept in this file, which is created or
+        // truncated, instead of in memory.
+        std::string working_file;
+    };
+
+    // `lines` hold '>', 'v' and '.', all the same length. Trailing empty
+    // lines are ignored.
+    explicit Herd(absl::Span<const absl::string_view> lines);
+
+    // Parses the grid in `text`, e.g. a mapped input file, straight into the
+    // herds, one band per task. Returns nullptr if the working file can't be
+    // created or mapped.
+    static std::unique_ptr<Herd> Parse(absl::string_view text,
+                                       const Options& options = {});
+
+    Herd(const Herd&) = delete;
+    Herd& operator=(const Herd&) = delete;
+    ~Herd();
+
+    int rows() const { return rows_; }
+    int cols() const { return cols_; }
+
+    // Moves the east herd, then the south herd. Returns whether anything
+    // moved.
+    bool Step();
+
+    // Steps until nothing moves and returns the number of that last step.
+    int64_t StepsUntilStill();
+
+    std::string DebugPrint() const;
+
+   private:
+    // Bits of moves_.
+    static constexpr uint8_t kMovedEast = 1;
+    static constexpr uint8_t kMovedSouth = 2;
+
+    // Rows [begin, end), stepped by one task.
+    struct Band {
+        int begin = 0;
+        int end = 0;
+        // Scratch rows for the row kernels.
+        std::vector<uint64_t> movers;
+        std::vector<uint64_t> leaving;
+        // South herd of row `begin` before the south phase.
+        std::vector<uint64_t> halo;
+        // Cucumbers that left row `end - 1` southwards, or nullptr.
+        const uint64_t* outflow = nullptr;
+    };
+
+    uint64_t* EastRow(int row) {
+        return east_ + static_cast<size_t>(row) * words_per_row_;
+    }
+    uint64_t* SouthRow(int row) {
+        return south_ + static_cast<size_t>(row) * words_per_row_;
+    }
+
+    Herd() = default;
+
+    // Sets the grid size and the per-row and per-band state.
+    void Init(int rows, int cols);
+
+    // Points east_ and south_ at cleared storage, in `working_file` if it is
+    // not empty. Returns false if the file can't be created or mapped.
+    bool Allocate(const std::string& working_file);
+
+    // Sets row `row` of both herds from `line`, which is cols_ long.
+    void ParseRow(int row, absl::string_view line);
+
+    // Asks the kernel to read the active rows of `band` from the working
+    // file.
+    void Prefetch(const Band& band) const;
+
+    // Runs `fn(band, next_band)` for every band, in parallel if there are
+    // several.
+    template <typename Fn>
+    void ForEachBand(Fn fn);
+
+    void StepEast(Band& band);
+    void StepSouth(Band& band, const Band& next);
+
+    // Derives active_ for the next step from moves_, which it clears.
+    // Returns whether any row changed.
+    bool UpdateActive();
+
+    int rows_ = 0;
+    int cols_ = 0;
+    int words_per_row_ = 0;
+    // rows_ * words_per_row_ words each, in storage_ or mapping_.
+    uint64_t* east_ = nullptr;
+    uint64_t* south_ = nullptr;
+    std::vector<uint64_t> storage_;
+    void* mapping_ = nullptr;
+    size_t mapping_size_ = 0;
+    std::vector<Band> bands_;
+    // One row of zeros.
+    std::vector<uint64_t> zeros_;
+    // Per row, the kMoved* bits for the cucumbers that left it this step.
+    std::vector<uint8_t> moves_;
+    // Per row, whether it changed in the last step.
+    std::vector<uint8_t> changed_;
+    // Per row, whether it may change in this step.
+    std::vector<uint8_t> active_;
+};
+
+}  // namespace aoc2022
@@ -0,0 +1,56 @@
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/strings/str_cat.h"
+#include "cpu_topology.h"
+#include "executor.h"
+#include "herd.h"
+#include "mapped_file.h"
+#include "runner.h"
+#include "thread_pool.h"
+
+ABSL_FLAG(int, threads, 0,
+          "Cap on stepping threads. 0 uses every CPU available to the "
+          "process, capped by its cgroup CPU quota.");
+ABSL_FLAG(std::string, working_file, "",
+          "If set, the grid is stepped in this file instead of in memory, "
+          "for grids that don't fit in RAM. Any existing file is replaced.");
+ABSL_FLAG(common::Placement, placement, common::Placement::kNone,
+          "Pinning of stepping threads to CPUs: none, compact (fill one "
+          "socket first) or scatter (round-robin over sockets).");
+
+namespace {
+
+common::SolveFn ParseBitset(const common::MappedFile& input) {
+    std::unique_ptr<aoc2022::Herd> herd = aoc2022::Herd::Parse(
+        input.contents(), {.working_file = absl::GetFlag(FLAGS_working_file)});
+    if (herd == nullptr) {
+        std::cerr << "Failed to map " << absl::GetFlag(FLAGS_working_file)
+                  << std::endl;
+        return nullptr;
+    }
+    return [herd = std::move(herd)] {
+        return absl::StrCat(herd->StepsUntilStill());
+    };
+}
+
+}  // namespace
+
+// Program entry point.
+// Prints the first step on which no sea cucumber in --input moves.
+int main(int argc, char** argv) {
+    absl::ParseCommandLine(argc, argv);
+
+    common::SetDefaultExecutorOptions(common::ThreadPool::Options{
+        .num_threads = absl::GetFlag(FLAGS_threads),
+        .placement = absl::GetFlag(FLAGS_placement),
+    });
+    std::vector<common::Engine> engines;
+    engines.push_back({.name = "bitset", .parse = ParseBitset});
+    return common::RunSolver(std::move(engines));
+}